@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# Measures how long the compiler takes with large generated input files.
+# The generated files go to tmp/benchmark/.
+#
+# Usage: ./benchmark.sh
+#
+set -e -o pipefail
+
+rm -rf tmp/benchmark
+mkdir -vp tmp/benchmark
+
+TIMEFORMAT="%Rs"
+
+# Runs a command three times and shows the fastest time.
+function measure()
+{
+    local description="$1"
+    shift
+    local best=""
+    for i in 1 2 3; do
+        local t=$( { time "$@" > /dev/null 2>&1; } 2>&1 )
+        t=${t%s}
+        if [ -z "$best" ] || awk "BEGIN{exit !($t < $best)}"; then
+            best=$t
+        fi
+    done
+    printf "  %-40s %ss\n" "$description" "$best"
+}
+
+
+# The tokenizer has SIMD and scalar versions of its inner loops.
+# Compile the compiler both ways so that we can compare.
+make
+cp jou tmp/benchmark/jou-simd
+CFLAGS=-DNO_SIMD_TOKENIZER make -B jou
+cp jou tmp/benchmark/jou-scalar
+make -B jou
+
+# A file that is mostly comments, indentation, long names and long strings.
+# The other compilation steps have very little to do with it.
+python3 -c '
+print("declare puts(s: byte*) -> int")
+print("def main() -> int:")
+for i in range(200):
+    print("    # " + "This is a long comment that the tokenizer must skip. " * 20)
+    print("    " * 5)
+    print("    long_variable_name_number_%d_that_takes_a_while_to_tokenize = %d" % (i, i))
+    print("    puts(\"" + "Long string literals are copied byte by byte. " * 20 + "\")")
+for i in range(200000):
+    print("    # " + "x" * 200)
+print("    return 0")
+' > tmp/benchmark/tokenizer.jou
+
+echo ""
+echo "Tokenizer ($(du -h tmp/benchmark/tokenizer.jou | cut -f1) file):"
+measure "SIMD" tmp/benchmark/jou-simd tmp/benchmark/tokenizer.jou
+measure "scalar (-DNO_SIMD_TOKENIZER)" tmp/benchmark/jou-scalar tmp/benchmark/tokenizer.jou
+
+# Long expressions that use every precedence level.
+# The syntax error at the end stops the compiler right after parsing.
+python3 -c '
+print("def main() -> int:")
+for i in range(20000):
+    print("    x = not a*b + c/d - e*f as long < (g + h*i) as long and not p.x[i + 1]*2 == *q + &r->y and (s or t or u)")
+    print("    foo(a + b*c, d[e] - f/g, h->i.j as int, k == l or m != n, ++o * p--)")
+print("    x = )")
+' > tmp/benchmark/parser.jou
+
+echo ""
+echo "Parser ($(du -h tmp/benchmark/parser.jou | cut -f1) file):"
+measure "tokenize and parse" ./jou tmp/benchmark/parser.jou
+
+# Huge functions: one with lots of straight-line code, one with lots of small blocks.
+# Most of the time goes to building, simplifying and compiling the CFG.
+python3 -c '
+print("def straight(x: int, y: int) -> int:")
+for i in range(30000):
+    print("    x = x*3 + y - %d" % (i % 7))
+    print("    y = (y + x) * 2")
+print("    return x")
+print("def branchy(x: int, y: int) -> int:")
+for i in range(3000):
+    print("    if x == %d:" % i)
+    print("        y = y + 1")
+    print("    else:")
+    print("        x = x + 1")
+print("    return y")
+print("def main() -> int:")
+print("    straight(1, 2)")
+print("    branchy(1, 2)")
+print("    return 0")
+' > tmp/benchmark/functions.jou
+
+echo ""
+echo "Large functions ($(du -h tmp/benchmark/functions.jou | cut -f1) file):"
+measure "compile and run" ./jou tmp/benchmark/functions.jou
@@ -7,41 +7,68 @@ struct State {
     CfBlock *current_block;
     List(CfBlock *) breakstack;
     List(CfBlock *) continuestack;
+
+    // Instructions of current_block are collected here and copied to the
+    // arena in one piece when the block is done (see finish_block()).
+    List(CfInstruction) instructions;
+    List(const Variable *) operands;  // operands of all instructions, back to back
 };
 
 static const Variable *find_variable(const struct State *st, const char *name)
 {
-    for (Variable **var = st->typectx->variables.ptr; var < End(st->typectx->variables); var++)
-        if (!strcmp((*var)->name, name))
-            return *var;
-    return NULL;
+    int i = namemap_get(&st->typectx->variable_indexes, name);
+    return i == -1 ? NULL : st->typectx->variables.ptr[i];
 }
 
 static Variable *add_variable(struct State *st, const Type *t)
 {
-    Variable *var = calloc(1, sizeof *var);
+    Variable *var = arena_alloc(st->typectx->arena, sizeof *var);
     var->id = st->typectx->variables.len;
     var->type = t;
     Append(&st->typectx->variables, var);
     return var;
 }
 
-static const ExpressionTypes *get_expr_types(const struct State *st, const AstExpression *expr)
+static const ExpressionTypes *get_expr_types(const AstExpression *expr)
 {
-    // TODO: a fancy binary search algorithm (need to add sorting)
-    for (int i = 0; i < st->typectx->expr_types.len; i++)
-        if (st->typectx->expr_types.ptr[i]->expr == expr)
-            return st->typectx->expr_types.ptr[i];
-    return NULL;
+    // Function calls to "-> void" functions have no type.
+    return expr->types.type ? &expr->types : NULL;
 }
 
 static CfBlock *add_block(const struct State *st)
 {
-    CfBlock *block = calloc(1, sizeof *block);
-    Append(&st->cfg->all_blocks, block);
+    CfBlock *block = arena_alloc(st->typectx->arena, sizeof *block);
+    block->id = st->cfg->all_blocks.len;
+    ArenaAppend(st->typectx->arena, &st->cfg->all_blocks, block);
     return block;
 }
 
+/*
+Move instructions of the current block to the arena. This way each block gets
+an array of exactly the right size, and operands of all its instructions are
+stored in one contiguous array instead of a separate allocation per instruction.
+*/
+static void finish_block(struct State *st)
+{
+    CfBlock *b = st->current_block;
+    assert(b->instructions.len == 0);
+    if (st->instructions.len == 0)
+        return;
+
+    const Variable **pool = arena_memdup(st->typectx->arena, st->operands.ptr, sizeof(pool[0]) * st->operands.len);  // NOLINT
+    b->instructions.ptr = arena_memdup(st->typectx->arena, st->instructions.ptr, sizeof(CfInstruction) * st->instructions.len);
+    b->instructions.len = b->instructions.alloc = st->instructions.len;
+
+    // Operands are in the pool in the same order as the instructions.
+    for (CfInstruction *ins = b->instructions.ptr; ins < End(b->instructions); ins++) {
+        ins->operands = ins->noperands ? pool : NULL;
+        pool += ins->noperands;
+    }
+
+    st->instructions.len = 0;
+    st->operands.len = 0;
+}
+
 static void add_jump(struct State *st, const Variable *branchvar, CfBlock *iftrue, CfBlock *iffalse, CfBlock *new_current_block)
 {
     assert(iftrue);
@@ -51,6 +78,7 @@ static void add_jump(struct State *st, const Variable *branchvar, CfBlock *iftru
         assert(branchvar->type == boolType);
     }
 
+    finish_block(st);
     st->current_block->branchvar = branchvar;
     st->current_block->iftrue = iftrue;
     st->current_block->iffalse = iffalse;
@@ -59,7 +87,7 @@ static void add_jump(struct State *st, const Variable *branchvar, CfBlock *iftru
 
 // returned pointer is only valid until next call to add_instruction()
 static CfInstruction *add_instruction(
-    const struct State *st,
+    struct State *st,
     Location location,
     enum CfInstructionKind k,
     const union CfInstructionData *dat,
@@ -70,16 +98,12 @@ static CfInstruction *add_instruction(
     if (dat)
         ins.data=*dat;
 
+    // ins.operands is set in finish_block()
     while (operands && operands[ins.noperands])
-        ins.noperands++;
-    if (ins.noperands) {
-        size_t nbytes = sizeof(ins.operands[0]) * ins.noperands;  // NOLINT
-        ins.operands = malloc(nbytes);
-        memcpy(ins.operands, operands, nbytes);
-    }
+        Append(&st->operands, operands[ins.noperands++]);
 
-    Append(&st->current_block->instructions, ins);
-    return &st->current_block->instructions.ptr[st->current_block->instructions.len - 1];
+    Append(&st->instructions, ins);
+    return End(st->instructions) - 1;
 }
 
 // add_instruction() takes many arguments. Let's hide the mess a bit.
@@ -88,7 +112,7 @@ static CfInstruction *add_instruction(
 #define add_binary_op(st, loc, op, lhs, rhs, target) \
     add_instruction((st), (loc), (op), NULL, (const Variable*[]){(lhs),(rhs),NULL}, (target))
 #define add_constant(st, loc, c, target) \
-    add_instruction((st), (loc), CF_CONSTANT, &(union CfInstructionData){ .constant=copy_constant(&(c)) }, NULL, (target))
+    add_instruction((st), (loc), CF_CONSTANT, &(union CfInstructionData){ .constant=copy_constant((st)->typectx->arena, &(c)) }, NULL, (target))
 
 
 static const Variable *build_cast(
@@ -159,22 +183,14 @@ static const Variable *build_struct_field_pointer(
     assert(structinstance->type->data.valuetype->kind == TYPE_STRUCT);
     const Type *structtype = structinstance->type->data.valuetype;
 
-    for (int i = 0; i < structtype->data.structfields.count; i++) {
-        char name[100];
-        safe_strcpy(name, structtype->data.structfields.names[i]);
-        const Type *type = structtype->data.structfields.types[i];
-
-        if (!strcmp(name, fieldname)) {
-            union CfInstructionData dat;
-            safe_strcpy(dat.fieldname, name);
-
-            Variable* result = add_variable(st, get_pointer_type(type));
-            add_instruction(st, location, CF_PTR_STRUCT_FIELD, &dat, (const Variable*[]){structinstance,NULL}, result);
-            return result;
-        }
-    }
+    int i = find_struct_field(structtype, fieldname);
+    assert(i != -1);
+    const Type *type = structtype->data.structfields.types[i];
 
-    assert(0);
+    union CfInstructionData dat = { .field = { .fieldname = fieldname, .fieldindex = i } };
+    Variable* result = add_variable(st, get_pointer_type(type));
+    add_instruction(st, location, CF_PTR_STRUCT_FIELD, &dat, (const Variable*[]){structinstance,NULL}, result);
+    return result;
 }
 
 static const Variable *build_expression(struct State *st, const AstExpression *expr);
@@ -195,7 +211,7 @@ static const Variable *build_increment_or_decrement(
     assert(addr->type->kind == TYPE_POINTER);
     const Type *t = addr->type->data.valuetype;
     if (!is_integer_type(t) && !is_pointer_type(t))
-        fail_with_error(location, "cannot %s a value of type %s", diff==1?"increment":"decrement", t->name);
+        fail_with_error(location, "cannot %s a value of type %s", diff==1?"increment":"decrement", type_name(t));
 
     const Variable *old_value = add_variable(st, t);
     const Variable *new_value = add_variable(st, t);
@@ -303,7 +319,7 @@ static const Variable *build_address_of_expression(struct State *st, const AstEx
     case AST_EXPR_DEREFERENCE:
     {
         // &*foo --> just evaluate foo
-        return build_expression(st, &address_of_what->data.operands[0]);
+        return build_expression(st, address_of_what->data.operands[0]);
     }
     case AST_EXPR_DEREF_AND_GET_FIELD:
     {
@@ -323,8 +339,8 @@ static const Variable *build_address_of_expression(struct State *st, const AstEx
     case AST_EXPR_INDEXING:
     {
         // &ptr[index]
-        const Variable *ptr = build_expression(st, &address_of_what->data.operands[0]);
-        const Variable *index = build_expression(st, &address_of_what->data.operands[1]);
+        const Variable *ptr = build_expression(st, address_of_what->data.operands[0]);
+        const Variable *index = build_expression(st, address_of_what->data.operands[1]);
         assert(ptr->type->kind == TYPE_POINTER);
         assert(is_integer_type(index->type));
 
@@ -348,17 +364,18 @@ static const Variable *build_function_call(struct State *st, const AstExpression
     int nargs = expr->data.call.nargs;
     const Variable **args = calloc(nargs + 1, sizeof(args[0]));  // NOLINT
     for (int i = 0; i < nargs; i++)
-        args[i] = build_expression(st, &expr->data.call.args[i]);
+        args[i] = build_expression(st, expr->data.call.args[i]);
 
-    const ExpressionTypes *types = get_expr_types(st, expr);
+    const ExpressionTypes *types = get_expr_types(expr);
     const Variable *return_value;
     if (types)
         return_value = add_variable(st, types->type);
     else
         return_value = NULL;
 
-    union CfInstructionData data;
-    safe_strcpy(data.funcname, expr->data.call.calledname);
+    int funcindex = namemap_get(&st->typectx->function_indexes, expr->data.call.calledname);
+    assert(funcindex != -1);
+    union CfInstructionData data = { .call = { .funcname = expr->data.call.calledname, .funcindex = funcindex } };
     add_instruction(st, expr->location, CF_CALL, &data, args, return_value);
 
     free(args);
@@ -374,8 +391,8 @@ static const Variable *build_struct_init(struct State *st, const Type *type, con
     add_unary_op(st, location, CF_PTR_MEMSET_TO_ZERO, instanceptr, NULL);
 
     for (int i = 0; i < call->nargs; i++) {
-        const Variable *fieldptr = build_struct_field_pointer(st, instanceptr, call->argnames[i], call->args[i].location);
-        const Variable *fieldval = build_expression(st, &call->args[i]);
+        const Variable *fieldptr = build_struct_field_pointer(st, instanceptr, call->argnames[i], call->args[i]->location);
+        const Variable *fieldval = build_expression(st, call->args[i]);
         add_binary_op(st, location, CF_PTR_STORE, fieldptr, fieldval, NULL);
     }
 
@@ -384,7 +401,7 @@ static const Variable *build_struct_init(struct State *st, const Type *type, con
 
 static const Variable *build_expression(struct State *st, const AstExpression *expr)
 {
-    const ExpressionTypes *types = get_expr_types(st, expr);
+    const ExpressionTypes *types = get_expr_types(expr);
 
     const Variable *result, *temp;
 
@@ -407,7 +424,7 @@ static const Variable *build_expression(struct State *st, const AstExpression *e
         add_unary_op(st, expr->location, CF_PTR_LOAD, temp, result);
         break;
     case AST_EXPR_ADDRESS_OF:
-        result = build_address_of_expression(st, &expr->data.operands[0]);
+        result = build_address_of_expression(st, expr->data.operands[0]);
         break;
     case AST_EXPR_GET_VARIABLE:
         result = find_variable(st, expr->data.varname);
@@ -420,7 +437,7 @@ static const Variable *build_expression(struct State *st, const AstExpression *e
         }
         break;
     case AST_EXPR_DEREFERENCE:
-        temp = build_expression(st, &expr->data.operands[0]);
+        temp = build_expression(st, expr->data.operands[0]);
         result = add_variable(st, types->type);
         add_unary_op(st, expr->location, CF_PTR_LOAD, temp, result);
         break;
@@ -429,13 +446,13 @@ static const Variable *build_expression(struct State *st, const AstExpression *e
         add_constant(st, expr->location, expr->data.constant, result);
         break;
     case AST_EXPR_AND:
-        result = build_and_or(st, &expr->data.operands[0], &expr->data.operands[1], AND);
+        result = build_and_or(st, expr->data.operands[0], expr->data.operands[1], AND);
         break;
     case AST_EXPR_OR:
-        result = build_and_or(st, &expr->data.operands[0], &expr->data.operands[1], OR);
+        result = build_and_or(st, expr->data.operands[0], expr->data.operands[1], OR);
         break;
     case AST_EXPR_NOT:
-        temp = build_expression(st, &expr->data.operands[0]);
+        temp = build_expression(st, expr->data.operands[0]);
         result = add_variable(st, boolType);
         add_unary_op(st, expr->location, CF_BOOL_NEGATE, temp, result);
         break;
@@ -452,8 +469,8 @@ static const Variable *build_expression(struct State *st, const AstExpression *e
         {
             // Refactoring note: Make sure to evaluate lhs first. C doesn't guarantee evaluation
             // order of function arguments.
-            const Variable *lhs = build_expression(st, &expr->data.operands[0]);
-            const Variable *rhs = build_expression(st, &expr->data.operands[1]);
+            const Variable *lhs = build_expression(st, expr->data.operands[0]);
+            const Variable *rhs = build_expression(st, expr->data.operands[1]);
             result = build_binop(st, expr->kind, expr->location, lhs, rhs, types->type);
             break;
         }
@@ -472,7 +489,7 @@ static const Variable *build_expression(struct State *st, const AstExpression *e
                 case AST_EXPR_POST_DECREMENT: pop=POST; diff=-1; break;
                 default: assert(0);
             }
-            result = build_increment_or_decrement(st, expr->location, &expr->data.operands[0], pop, diff);
+            result = build_increment_or_decrement(st, expr->location, expr->data.operands[0], pop, diff);
             break;
         }
     case AST_EXPR_AS:
@@ -498,7 +515,7 @@ static void build_if_statement(struct State *st, const AstIfStatement *ifstmt)
     CfBlock *done = add_block(st);
     for (int i = 0; i < ifstmt->n_if_and_elifs; i++) {
         const Variable *cond = build_expression(
-            st, &ifstmt->if_and_elifs[i].condition);
+            st, ifstmt->if_and_elifs[i].condition);
         CfBlock *then = add_block(st);
         CfBlock *otherwise = add_block(st);
 
@@ -565,14 +582,14 @@ static void build_statement(struct State *st, const AstStatement *stmt)
     case AST_STMT_WHILE:
         build_loop(
             st, "while",
-            NULL, &stmt->data.whileloop.condition, NULL,
+            NULL, stmt->data.whileloop.condition, NULL,
             &stmt->data.whileloop.body);
         break;
 
     case AST_STMT_FOR:
         build_loop(
             st, "for",
-            stmt->data.forloop.init, &stmt->data.forloop.cond, stmt->data.forloop.incr,
+            stmt->data.forloop.init, stmt->data.forloop.cond, stmt->data.forloop.incr,
             &stmt->data.forloop.body);
         break;
 
@@ -590,8 +607,8 @@ static void build_statement(struct State *st, const AstStatement *stmt)
 
     case AST_STMT_ASSIGN:
         {
-            const AstExpression *targetexpr = &stmt->data.assignment.target;
-            const AstExpression *valueexpr = &stmt->data.assignment.value;
+            const AstExpression *targetexpr = stmt->data.assignment.target;
+            const AstExpression *valueexpr = stmt->data.assignment.value;
 
             // TODO: is this evaluation order good?
             if (targetexpr->kind == AST_EXPR_GET_VARIABLE) {
@@ -610,13 +627,14 @@ static void build_statement(struct State *st, const AstStatement *stmt)
 
     case AST_STMT_RETURN_VALUE:
     {
-        const Variable *retvalue = build_expression(st, &stmt->data.expression);
-        const Variable *retvariable = find_variable(st, "return");
+        const Variable *retvalue = build_expression(st, stmt->data.expression);
+        const Variable *retvariable = find_variable(st, known_names.kw_return);
         assert(retvariable);
         add_unary_op(st, stmt->location, CF_VARCPY, retvalue, retvariable);
     }
     __attribute__((fallthrough));
     case AST_STMT_RETURN_WITHOUT_VALUE:
+        finish_block(st);
         st->current_block->iftrue = &st->cfg->end_block;
         st->current_block->iffalse = &st->cfg->end_block;
         st->current_block = add_block(st);  // an unreachable block
@@ -632,7 +650,7 @@ static void build_statement(struct State *st, const AstStatement *stmt)
         break;
 
     case AST_STMT_EXPRESSION_STATEMENT:
-        build_expression(st, &stmt->data.expression);
+        build_expression(st, stmt->data.expression);
         break;
     }
 }
@@ -640,14 +658,17 @@ static void build_statement(struct State *st, const AstStatement *stmt)
 static void build_body(struct State *st, const AstBody *body)
 {
     for (int i = 0; i < body->nstatements; i++)
-        build_statement(st, &body->statements[i]);
+        build_statement(st, body->statements[i]);
 }
 
 static CfGraph *build_function(struct State *st, const AstBody *body)
 {
-    st->cfg = calloc(1, sizeof *st->cfg);
-    Append(&st->cfg->all_blocks, &st->cfg->start_block);
-    Append(&st->cfg->all_blocks, &st->cfg->end_block);
+    st->cfg = arena_alloc(st->typectx->arena, sizeof *st->cfg);
+    st->cfg->arena = st->typectx->arena;
+    st->cfg->start_block.id = 0;
+    st->cfg->end_block.id = 1;
+    ArenaAppend(st->typectx->arena, &st->cfg->all_blocks, &st->cfg->start_block);
+    ArenaAppend(st->typectx->arena, &st->cfg->all_blocks, &st->cfg->end_block);
 
     st->current_block = &st->cfg->start_block;
 
@@ -656,48 +677,24 @@ static CfGraph *build_function(struct State *st, const AstBody *body)
     assert(st->breakstack.len == 0 && st->continuestack.len == 0);
 
     // Implicit return at the end of the function
+    finish_block(st);
     st->current_block->iftrue = &st->cfg->end_block;
     st->current_block->iffalse = &st->cfg->end_block;
 
     for (Variable **v = st->typectx->variables.ptr; v < End(st->typectx->variables); v++)
-        Append(&st->cfg->variables, *v);
+        ArenaAppend(st->typectx->arena, &st->cfg->variables, *v);
 
     reset_type_context(st->typectx);
     return st->cfg;
 }
 
-CfGraphFile build_control_flow_graphs(AstToplevelNode *ast)
+CfGraph *build_control_flow_graph(TypeContext *typectx, const AstBody *body)
 {
-    CfGraphFile result = { .filename = ast->location.filename };
-    struct State st = { .typectx = &result.typectx };
-
-    int n = 0;
-    while (ast[n].kind!=AST_TOPLEVEL_END_OF_FILE) n++;
-    result.graphs = malloc(sizeof(result.graphs[0]) * n);  // NOLINT
-
-    while (ast->kind != AST_TOPLEVEL_END_OF_FILE) {
-        switch(ast->kind) {
-        case AST_TOPLEVEL_END_OF_FILE:
-            assert(0);
-        case AST_TOPLEVEL_DECLARE_FUNCTION:
-            typecheck_function(&result.typectx, ast->location, &ast->data.decl_signature, NULL);
-            result.graphs[result.nfuncs++] = NULL;
-            break;
-        case AST_TOPLEVEL_DEFINE_FUNCTION:
-            typecheck_function(&result.typectx, ast->location, &ast->data.funcdef.signature, &ast->data.funcdef.body);
-            result.graphs[result.nfuncs++] = build_function(&st, &ast->data.funcdef.body);
-            break;
-        case AST_TOPLEVEL_DEFINE_STRUCT:
-            typecheck_struct(&result.typectx, &ast->data.structdef, ast->location);
-            break;
-        }
-        ast++;
-    }
-
-    assert(result.nfuncs == st.typectx->function_signatures.len);
-    result.signatures = st.typectx->function_signatures.ptr;
-
+    struct State st = { .typectx = typectx };
+    CfGraph *cfg = build_function(&st, body);
     free(st.breakstack.ptr);
     free(st.continuestack.ptr);
-    return result;
+    free(st.instructions.ptr);
+    free(st.operands.ptr);
+    return cfg;
 }
@@ -4,11 +4,23 @@
 #include <stdlib.h>
 #include <string.h>
 #include <llvm-c/Core.h>
+#include <llvm-c/Target.h>
 #include <llvm-c/Types.h>
 #include "jou_compiler.h"
 #include "util.h"
 
+static LLVMTypeRef create_llvm_type(const Type *type);
+
+// The LLVM type of each type is created only once. All LLVM types live in the global LLVM context.
 static LLVMTypeRef codegen_type(const Type *type)
+{
+    LLVMTypeRef *cache = get_llvm_type_cache(type);
+    if (!*cache)
+        *cache = create_llvm_type(type);
+    return *cache;
+}
+
+static LLVMTypeRef create_llvm_type(const Type *type)
 {
     switch(type->kind) {
     case TYPE_POINTER:
@@ -23,11 +35,14 @@ static LLVMTypeRef codegen_type(const Type *type)
         return LLVMInt1Type();
     case TYPE_STRUCT:
         {
+            // Named struct types show up as "%Foo = type { ... }" in the LLVM IR.
+            // Two structs with the same fields are different types, and LLVM knows it.
+            LLVMTypeRef result = LLVMStructCreateNamed(LLVMGetGlobalContext(), type_name(type));
             int n = type->data.structfields.count;
             LLVMTypeRef *elems = malloc(sizeof(elems[0]) * n);  // NOLINT
             for (int i = 0; i < n; i++)
                 elems[i] = codegen_type(type->data.structfields.types[i]);
-            LLVMTypeRef result = LLVMStructType(elems, type->data.structfields.count, false);
+            LLVMStructSetBody(result, elems, n, false);
             free(elems);
             return result;
         }
@@ -35,56 +50,74 @@ static LLVMTypeRef codegen_type(const Type *type)
     assert(0);
 }
 
+/*
+Functions of the module being generated. Function calls in the control flow
+graph refer to functions by their index in TypeContext.function_signatures,
+and each function is recorded here right after it is typechecked, so the same
+indexes can be used here.
+
+A declaration is added to the LLVM module only when something calls it, so
+that big headers with many declarations don't make the module big.
+
+Function i calls functions calls.ptr[callstart.ptr[i]], calls.ptr[callstart.ptr[i]+1], ...
+up to where the calls of function i+1 start.
+*/
+struct ModuleFunction {
+    const char *name;
+    LLVMTypeRef type;
+    LLVMValueRef value;  // NULL for a declaration that hasn't been called yet
+};
+static struct {
+    bool inited;
+    LLVMModuleRef module;
+    List(struct ModuleFunction) functions;
+    List(int) callstart;
+    List(int) calls;
+} global_state;
+
 struct State {
     LLVMModuleRef module;
     LLVMBuilderRef builder;
-    Variable **cfvars, **cfvars_end;
-    // All local variables are represented as pointers to stack space, even
-    // if they are never reassigned. LLVM will optimize the mess.
-    LLVMValueRef *llvm_locals;
+    /*
+    Local variables whose address is taken live in stack space. Other local
+    variables are SSA values: we keep track of the current value of each
+    variable in the block being generated, and use phi nodes when a variable
+    can come from several blocks.
+    */
+    LLVMValueRef *llvm_locals_by_id;  // pointer to stack space or NULL, indexed by Variable.id
+    LLVMValueRef *ssa_values_by_id;  // current value or NULL if not set, indexed by Variable.id
+    LLVMBasicBlockRef *llvm_blocks_by_id;  // indexed by CfBlock.id
 };
 
 static LLVMValueRef get_pointer_to_local_var(const struct State *st, const Variable *cfvar)
 {
     assert(cfvar);
-    /*
-    The loop below looks stupid, but I don't see a better alternative.
-
-    I want CFG variables to be used as pointers, so that it's easy to refer to a
-    variable's name and type, check if you have the same variable, etc. But I
-    can't make a List of variables when building CFG, because existing variable
-    pointers would become invalid as the list grows. The solution is to allocate
-    each variable separately when building the CFG.
-
-    Another idea I had was to count the number of variables needed beforehand,
-    so I wouldn't need to ever resize the list of variables, but the CFG building
-    is already complicated enough as is.
-    */
-    for (Variable **v = st->cfvars; v < st->cfvars_end; v++)
-        if (*v == cfvar)
-            return st->llvm_locals[v - st->cfvars];
-    assert(0);
+    assert(st->llvm_locals_by_id[cfvar->id]);
+    return st->llvm_locals_by_id[cfvar->id];
 }
 
 static LLVMValueRef get_local_var(const struct State *st, const Variable *cfvar)
 {
-    LLVMValueRef varptr = get_pointer_to_local_var(st, cfvar);
-    return LLVMBuildLoad(st->builder, varptr, cfvar->name);
+    assert(cfvar);
+    if (st->llvm_locals_by_id[cfvar->id])
+        return LLVMBuildLoad(st->builder, st->llvm_locals_by_id[cfvar->id], cfvar->name ? cfvar->name : "");
+    if (st->ssa_values_by_id[cfvar->id])
+        return st->ssa_values_by_id[cfvar->id];
+    // Variable is used before it is set. There's already a warning about that.
+    return LLVMGetUndef(codegen_type(cfvar->type));
 }
 
 static void set_local_var(const struct State *st, const Variable *cfvar, LLVMValueRef value)
 {
     assert(cfvar);
-    for (Variable **v = st->cfvars; v < st->cfvars_end; v++) {
-        if (*v == cfvar) {
-            LLVMBuildStore(st->builder, value, st->llvm_locals[v - st->cfvars]);
-            return;
-        }
-    }
-    assert(0);
+    if (st->llvm_locals_by_id[cfvar->id])
+        LLVMBuildStore(st->builder, value, st->llvm_locals_by_id[cfvar->id]);
+    else
+        st->ssa_values_by_id[cfvar->id] = value;
 }
 
-static LLVMValueRef codegen_function_decl(const struct State *st, const Signature *sig)
+// Returns the index of the function in global_state.functions.
+static int codegen_function_decl(const Signature *sig)
 {
     LLVMTypeRef *argtypes = malloc(sig->nargs * sizeof(argtypes[0]));  // NOLINT
     for (int i = 0; i < sig->nargs; i++)
@@ -99,16 +132,24 @@ static LLVMValueRef codegen_function_decl(const struct State *st, const Signatur
     LLVMTypeRef functype = LLVMFunctionType(returntype, argtypes, sig->nargs, sig->takes_varargs);
     free(argtypes);
 
-    return LLVMAddFunction(st->module, sig->funcname, functype);
+    Append(&global_state.functions, (struct ModuleFunction){ .name = sig->funcname, .type = functype });
+    Append(&global_state.callstart, global_state.calls.len);
+    return global_state.functions.len - 1;
 }
 
-static LLVMValueRef codegen_call(const struct State *st, const char *funcname, LLVMValueRef *args, int nargs)
+static LLVMValueRef get_function(int funcindex)
 {
-    LLVMValueRef function = LLVMGetNamedFunction(st->module, funcname);
-    assert(function);
-    assert(LLVMGetTypeKind(LLVMTypeOf(function)) == LLVMPointerTypeKind);
-    LLVMTypeRef function_type = LLVMGetElementType(LLVMTypeOf(function));
-    assert(LLVMGetTypeKind(function_type) == LLVMFunctionTypeKind);
+    assert(0 <= funcindex && funcindex < global_state.functions.len);
+    struct ModuleFunction *f = &global_state.functions.ptr[funcindex];
+    if (!f->value)
+        f->value = LLVMAddFunction(global_state.module, f->name, f->type);
+    return f->value;
+}
+
+static LLVMValueRef codegen_call(const struct State *st, const char *funcname, int funcindex, LLVMValueRef *args, int nargs)
+{
+    LLVMValueRef function = get_function(funcindex);
+    LLVMTypeRef function_type = global_state.functions.ptr[funcindex].type;
 
     char debug_name[100] = {0};
     if (LLVMGetTypeKind(LLVMGetReturnType(function_type)) != LLVMVoidTypeKind)
@@ -155,7 +196,20 @@ static void codegen_instruction(const struct State *st, const CfInstruction *ins
                 LLVMValueRef *args = malloc(ins->noperands * sizeof(args[0]));  // NOLINT
                 for (int i = 0; i < ins->noperands; i++)
                     args[i] = getop(i);
-                LLVMValueRef return_value = codegen_call(st, ins->data.funcname, args, ins->noperands);
+
+                // Like in C, varargs smaller than int are converted to int, e.g. printf("%d", some_bool).
+                int nparams = LLVMCountParamTypes(global_state.functions.ptr[ins->data.call.funcindex].type);
+                for (int i = nparams; i < ins->noperands; i++) {
+                    const Type *t = ins->operands[i]->type;
+                    if (t->kind == TYPE_BOOL || (is_integer_type(t) && t->data.width_in_bits < 32)) {
+                        if (t->kind == TYPE_SIGNED_INTEGER)
+                            args[i] = LLVMBuildSExt(st->builder, args[i], LLVMInt32Type(), "vararg_promote");
+                        else
+                            args[i] = LLVMBuildZExt(st->builder, args[i], LLVMInt32Type(), "vararg_promote");
+                    }
+                }
+                LLVMValueRef return_value = codegen_call(st, ins->data.call.funcname, ins->data.call.funcindex, args, ins->noperands);
+                Append(&global_state.calls, ins->data.call.funcindex);
                 if (ins->destvar)
                     setdest(return_value);
                 free(args);
@@ -175,10 +229,8 @@ static void codegen_instruction(const struct State *st, const CfInstruction *ins
         case CF_PTR_STRUCT_FIELD:
             {
                 const Type *structtype = ins->operands[0]->type->data.valuetype;
-                int i = 0;
-                while (strcmp(structtype->data.structfields.names[i], ins->data.fieldname))
-                    i++;
-                setdest(LLVMBuildStructGEP2(st->builder, codegen_type(structtype), getop(0), i, ins->data.fieldname));
+                int i = ins->data.field.fieldindex;
+                setdest(LLVMBuildStructGEP2(st->builder, codegen_type(structtype), getop(0), i, ins->data.field.fieldname));
             }
             break;
         case CF_PTR_MEMSET_TO_ZERO:
@@ -222,6 +274,9 @@ static void codegen_instruction(const struct State *st, const CfInstruction *ins
             }
             break;
         case CF_BOOL_NEGATE: setdest(LLVMBuildXor(st->builder, getop(0), LLVMConstInt(LLVMInt1Type(), 1, false), "bool_negate")); break;
+        // Select instead of bitwise and/or, so that a garbage (poison) value on the right side doesn't matter when it isn't needed.
+        case CF_BOOL_AND: setdest(LLVMBuildSelect(st->builder, getop(0), getop(1), LLVMConstInt(LLVMInt1Type(), 0, false), "bool_and")); break;
+        case CF_BOOL_OR: setdest(LLVMBuildSelect(st->builder, getop(0), LLVMConstInt(LLVMInt1Type(), 1, false), getop(1), "bool_or")); break;
         case CF_PTR_CAST: setdest(LLVMBuildBitCast(st->builder, getop(0), codegen_type(ins->destvar->type), "ptr_cast")); break;
         case CF_INT_ADD: setdest(LLVMBuildAdd(st->builder, getop(0), getop(1), "int_add")); break;
         case CF_INT_SUB: setdest(LLVMBuildSub(st->builder, getop(0), getop(1), "int_sub")); break;
@@ -239,54 +294,188 @@ static void codegen_instruction(const struct State *st, const CfInstruction *ins
 #undef getop
 }
 
-static int find_block(const CfGraph *cfg, const CfBlock *b)
+/*
+Values of the SSA variables at the start of a block. If the block has only one
+predecessor, and it is generated before the block, the values are simply the
+values at the end of the predecessor. Otherwise they are phi nodes.
+*/
+struct BlockStart {
+    int nvars;
+    const Variable **vars;  // variables that are live at start of block
+    LLVMValueRef *values;  // NULL means that the variable was not set
+    bool phis;
+};
+
+// Called at the end of a block, for each block that it jumps to.
+static void pass_values_to_block(const struct State *st, struct BlockStart *target, LLVMBasicBlockRef from)
 {
-    for (int i = 0; i < cfg->all_blocks.len; i++)
-        if (cfg->all_blocks.ptr[i] == b)
-            return i;
-    assert(0);
+    for (int i = 0; i < target->nvars; i++) {
+        LLVMValueRef value = get_local_var(st, target->vars[i]);
+        if (target->phis)
+            LLVMAddIncoming(target->values[i], &value, &from, 1);
+        else
+            target->values[i] = value;
+    }
 }
 
-static void codegen_function_def(struct State *st, const Signature *sig, const CfGraph *cfg)
+/*
+Blocks are generated in reverse postorder, so that each block comes after its
+predecessors, except for jumps back to the start of a loop. Unreachable blocks
+go last.
+*/
+static CfBlock **get_block_order(const CfGraph *cfg, const int *block_indexes_by_id)
 {
-    st->cfvars = cfg->variables.ptr;
-    st->cfvars_end = End(cfg->variables);
-    st->llvm_locals = malloc(sizeof(st->llvm_locals[0]) * cfg->variables.len); // NOLINT
+    int nblocks = cfg->all_blocks.len;
+    CfBlock **postorder = malloc(sizeof(postorder[0]) * nblocks);  // NOLINT
+    bool *visited = calloc(sizeof(visited[0]), nblocks);
+    struct { CfBlock *block; int nvisitedsucc; } *stack = malloc(sizeof(stack[0]) * nblocks);  // NOLINT
+    int stacklen = 0, npostorder = 0;
+
+    visited[0] = true;
+    stack[stacklen++].block = cfg->all_blocks.ptr[0];
+    stack[0].nvisitedsucc = 0;
+    while (stacklen > 0) {
+        CfBlock *b = stack[stacklen-1].block;
+        if (b != &cfg->end_block && stack[stacklen-1].nvisitedsucc < 2) {
+            CfBlock *succ = stack[stacklen-1].nvisitedsucc++ ? b->iffalse : b->iftrue;
+            int succidx = block_indexes_by_id[succ->id];
+            if (!visited[succidx]) {
+                visited[succidx] = true;
+                stack[stacklen].block = succ;
+                stack[stacklen].nvisitedsucc = 0;
+                stacklen++;
+            }
+        } else {
+            postorder[npostorder++] = b;
+            stacklen--;
+        }
+    }
+
+    CfBlock **result = malloc(sizeof(result[0]) * nblocks);  // NOLINT
+    for (int i = 0; i < npostorder; i++)
+        result[i] = postorder[npostorder-1-i];
+    for (int i = 0; i < nblocks; i++)
+        if (!visited[i])
+            result[npostorder++] = cfg->all_blocks.ptr[i];
+    assert(npostorder == nblocks);
+
+    free(postorder);
+    free(visited);
+    free(stack);
+    return result;
+}
 
-    LLVMValueRef llvm_func = codegen_function_decl(st, sig);
-    LLVMBasicBlockRef *blocks = malloc(sizeof(blocks[0]) * cfg->all_blocks.len); // NOLINT
-    for (int i = 0; i < cfg->all_blocks.len; i++) {
+static void codegen_function_def(struct State *st, const Signature *sig, const CfGraph *cfg, FunctionStats *stats)
+{
+    int nblocks = cfg->all_blocks.len;
+    int max_var_id = -1, max_block_id = -1;
+    for (int i = 0; i < cfg->variables.len; i++)
+        max_var_id = max(max_var_id, cfg->variables.ptr[i]->id);
+    for (int i = 0; i < nblocks; i++)
+        max_block_id = max(max_block_id, cfg->all_blocks.ptr[i]->id);
+    st->llvm_locals_by_id = calloc(sizeof(st->llvm_locals_by_id[0]), max_var_id + 1);
+    st->ssa_values_by_id = calloc(sizeof(st->ssa_values_by_id[0]), max_var_id + 1);
+    st->llvm_blocks_by_id = calloc(sizeof(st->llvm_blocks_by_id[0]), max_block_id + 1);
+    int *block_indexes_by_id = malloc(sizeof(block_indexes_by_id[0]) * (max_block_id + 1));  // NOLINT
+
+    LLVMValueRef llvm_func = get_function(codegen_function_decl(sig));
+    for (int i = 0; i < nblocks; i++) {
         char name[50];
         sprintf(name, "block%d", i);
-        blocks[i] = LLVMAppendBasicBlock(llvm_func, name);
+        st->llvm_blocks_by_id[cfg->all_blocks.ptr[i]->id] = LLVMAppendBasicBlock(llvm_func, name);
+        block_indexes_by_id[cfg->all_blocks.ptr[i]->id] = i;
     }
 
     assert(cfg->all_blocks.ptr[0] == &cfg->start_block);
-    LLVMPositionBuilderAtEnd(st->builder, blocks[0]);
+    LLVMPositionBuilderAtEnd(st->builder, st->llvm_blocks_by_id[cfg->start_block.id]);
 
-    // Allocate stack space for local variables at start of function.
-    LLVMValueRef return_value = NULL;
+    // Allocate stack space at start of function for variables whose address is taken.
+    const Variable **slots = assign_stack_slots(cfg);
+    LLVMTargetDataRef target_data = LLVMGetModuleDataLayout(st->module);
+    const Variable *return_var = NULL;
     for (int i = 0; i < cfg->variables.len; i++) {
         Variable *v = cfg->variables.ptr[i];
-        st->llvm_locals[i] = LLVMBuildAlloca(st->builder, codegen_type(v->type), v->name);
-        if (!strcmp(v->name, "return"))
-            return_value = st->llvm_locals[i];
+        if (slots[v->id]) {
+            // The first variable of each slot comes first, so its stack space has been allocated already.
+            int size = (int)LLVMABISizeOfType(target_data, codegen_type(v->type));
+            stats->stack_bytes_without_sharing += size;
+            if (slots[v->id] == v) {
+                st->llvm_locals_by_id[v->id] = LLVMBuildAlloca(st->builder, codegen_type(v->type), v->name ? v->name : "");
+                stats->stack_bytes += size;
+            } else {
+                st->llvm_locals_by_id[v->id] = st->llvm_locals_by_id[slots[v->id]->id];
+            }
+        }
+        if (v->name == known_names.kw_return)
+            return_var = v;
+    }
+    free(slots);
+
+    int *npreds = calloc(sizeof(npreds[0]), nblocks);
+    int *lastpred = malloc(sizeof(lastpred[0]) * nblocks);  // NOLINT
+    for (int i = 0; i < nblocks; i++) {
+        const CfBlock *b = cfg->all_blocks.ptr[i];
+        if (b == &cfg->end_block)
+            continue;
+        for (int k = 0; k < (b->iftrue == b->iffalse ? 1 : 2); k++) {
+            int succidx = block_indexes_by_id[(k ? b->iffalse : b->iftrue)->id];
+            npreds[succidx]++;
+            lastpred[succidx] = i;
+        }
+    }
+    // LLVM doesn't allow jumping to the first block of a function.
+    assert(npreds[0] == 0);
+
+    CfBlock **order = get_block_order(cfg, block_indexes_by_id);
+    int *positions = malloc(sizeof(positions[0]) * nblocks);  // NOLINT
+    for (int i = 0; i < nblocks; i++)
+        positions[block_indexes_by_id[order[i]->id]] = i;
+
+    // Create phi nodes before generating any code, so that jumps back to start of loop can add incoming values.
+    struct BlockStart *starts = calloc(sizeof(starts[0]), nblocks);
+    const Variable **temp = malloc(sizeof(temp[0]) * (cfg->variables.len + 1));  // NOLINT
+    Liveness *lv = compute_liveness(cfg);
+    for (int i = 0; i < nblocks; i++) {
+        const CfBlock *b = cfg->all_blocks.ptr[i];
+        int n = list_live_variables_at_start_of_block(lv, b, temp);
+        starts[i].nvars = n;
+        starts[i].vars = malloc(sizeof(starts[i].vars[0]) * (n + 1));  // NOLINT
+        memcpy(starts[i].vars, temp, sizeof(temp[0]) * n);
+        starts[i].values = calloc(sizeof(starts[i].values[0]), n + 1);
+        starts[i].phis = npreds[i] >= 2 || (npreds[i] == 1 && positions[lastpred[i]] >= positions[i]);
+
+        if (starts[i].phis) {
+            LLVMPositionBuilderAtEnd(st->builder, st->llvm_blocks_by_id[b->id]);
+            for (int k = 0; k < n; k++) {
+                const Variable *v = starts[i].vars[k];
+                starts[i].values[k] = LLVMBuildPhi(st->builder, codegen_type(v->type), v->name ? v->name : "");
+            }
+        }
     }
+    free_liveness(lv);
+    free(temp);
 
-    // Place arguments into the first n local variables.
-    for (int i = 0; i < sig->nargs; i++)
-        set_local_var(st, cfg->variables.ptr[i], LLVMGetParam(llvm_func, i));
+    for (CfBlock **b = order; b < &order[nblocks]; b++) {
+        LLVMBasicBlockRef llvm_block = st->llvm_blocks_by_id[(*b)->id];
+        LLVMPositionBuilderAtEnd(st->builder, llvm_block);
+
+        const struct BlockStart *start = &starts[block_indexes_by_id[(*b)->id]];
+        for (int i = 0; i < start->nvars; i++)
+            st->ssa_values_by_id[start->vars[i]->id] = start->values[i];
 
-    for (CfBlock **b = cfg->all_blocks.ptr; b <End(cfg->all_blocks); b++) {
-        LLVMPositionBuilderAtEnd(st->builder, blocks[b - cfg->all_blocks.ptr]);
+        if (*b == &cfg->start_block) {
+            // Place arguments into the first n local variables.
+            for (int i = 0; i < sig->nargs; i++)
+                set_local_var(st, cfg->variables.ptr[i], LLVMGetParam(llvm_func, i));
+        }
 
         for (CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++)
             codegen_instruction(st, ins);
 
         if (*b == &cfg->end_block) {
             assert((*b)->instructions.len == 0);
-            if (return_value)
-                LLVMBuildRet(st->builder, LLVMBuildLoad(st->builder, return_value, "return_value"));
+            if (return_var)
+                LLVMBuildRet(st->builder, get_local_var(st, return_var));
             else if (sig->returntype)  // "return" variable was deleted as unused
                 LLVMBuildUnreachable(st->builder);
             else
@@ -294,37 +483,114 @@ static void codegen_function_def(struct State *st, const Signature *sig, const C
         } else {
             assert((*b)->iftrue && (*b)->iffalse);
             if ((*b)->iftrue == (*b)->iffalse) {
-                LLVMBuildBr(st->builder, blocks[find_block(cfg, (*b)->iftrue)]);
+                LLVMBuildBr(st->builder, st->llvm_blocks_by_id[(*b)->iftrue->id]);
             } else {
                 assert((*b)->branchvar);
                 LLVMBuildCondBr(
                     st->builder,
                     get_local_var(st, (*b)->branchvar),
-                    blocks[find_block(cfg, (*b)->iftrue)],
-                    blocks[find_block(cfg, (*b)->iffalse)]);
+                    st->llvm_blocks_by_id[(*b)->iftrue->id],
+                    st->llvm_blocks_by_id[(*b)->iffalse->id]);
+                pass_values_to_block(st, &starts[block_indexes_by_id[(*b)->iffalse->id]], llvm_block);
             }
+            pass_values_to_block(st, &starts[block_indexes_by_id[(*b)->iftrue->id]], llvm_block);
         }
     }
 
-    free(blocks);
-    free(st->llvm_locals);
+    for (int i = 0; i < nblocks; i++) {
+        free(starts[i].vars);
+        free(starts[i].values);
+    }
+    free(starts);
+    free(order);
+    free(positions);
+    free(npreds);
+    free(lastpred);
+    free(block_indexes_by_id);
+    free(st->llvm_blocks_by_id);
+    free(st->llvm_locals_by_id);
+    free(st->ssa_values_by_id);
 }
 
-LLVMModuleRef codegen(const CfGraphFile *cfgfile)
+static void free_global_state(void)
 {
-    struct State st = {
-        .module = LLVMModuleCreateWithName(""),  // TODO: pass module name?
-        .builder = LLVMCreateBuilder(),
-    };
-    LLVMSetSourceFileName(st.module, cfgfile->filename, strlen(cfgfile->filename));
-
-    for (int i = 0; i < cfgfile->nfuncs; i++) {
-        if (cfgfile->graphs[i])
-            codegen_function_def(&st, &cfgfile->signatures[i], cfgfile->graphs[i]);
-        else
-            codegen_function_decl(&st, &cfgfile->signatures[i]);
+    free(global_state.functions.ptr);
+    free(global_state.callstart.ptr);
+    free(global_state.calls.ptr);
+}
+
+LLVMModuleRef codegen_create_module(const char *filename)
+{
+    if (!global_state.inited) {
+        global_state.inited = true;
+        atexit(free_global_state);
+    }
+
+    LLVMModuleRef module = LLVMModuleCreateWithName("");  // TODO: pass module name?
+    LLVMSetSourceFileName(module, filename, strlen(filename));
+    global_state.module = module;
+    global_state.functions.len = 0;
+    global_state.callstart.len = 0;
+    global_state.calls.len = 0;
+    return module;
+}
+
+void codegen_function(LLVMModuleRef module, const Signature *sig, const CfGraph *cfg, FunctionStats *stats)
+{
+    assert(module == global_state.module);
+    if (!cfg) {
+        codegen_function_decl(sig);  // goes to the module when something calls it
+        return;
     }
 
+    struct State st = { .module = module, .builder = LLVMCreateBuilder() };
+    codegen_function_def(&st, sig, cfg, stats);
     LLVMDisposeBuilder(st.builder);
-    return st.module;
+}
+
+void codegen_remove_unused_functions(LLVMModuleRef module)
+{
+    assert(module == global_state.module);
+    int nfuncs = global_state.functions.len;
+
+    // Depth-first search in the call graph, starting from main().
+    bool *used = calloc(sizeof(used[0]), nfuncs + 1);
+    List(int) stack = {0};
+    for (int i = 0; i < nfuncs; i++) {
+        if (global_state.functions.ptr[i].name == known_names.main) {
+            used[i] = true;
+            Append(&stack, i);
+        }
+    }
+    if (stack.len == 0) {
+        // No main(), so run_program() will fail anyway. Keep everything for --verbose.
+        free(used);
+        return;
+    }
+
+    while (stack.len > 0) {
+        int f = Pop(&stack);
+        int end = f+1 < nfuncs ? global_state.callstart.ptr[f+1] : global_state.calls.len;
+        for (int k = global_state.callstart.ptr[f]; k < end; k++) {
+            int callee = global_state.calls.ptr[k];
+            if (!used[callee]) {
+                used[callee] = true;
+                Append(&stack, callee);
+            }
+        }
+    }
+
+    // Uncalled declarations were never added to the module. What remains is unused
+    // definitions, and declarations that only unused definitions call.
+    for (int i = 0; i < nfuncs; i++) {
+        LLVMValueRef f = global_state.functions.ptr[i].value;
+        if (!used[i] && f) {
+            // Unused functions can call each other. Deleting a function that is still called would crash.
+            LLVMReplaceAllUsesWith(f, LLVMGetUndef(LLVMTypeOf(f)));
+            LLVMDeleteFunction(f);
+        }
+    }
+
+    free(used);
+    free(stack.ptr);
 }
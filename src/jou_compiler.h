@@ -8,9 +8,12 @@
 
 // don't like repeating "struct" outside this header file
 typedef struct CommandLineFlags CommandLineFlags;
+typedef struct FunctionStats FunctionStats;
 typedef struct Location Location;
 
 typedef struct Token Token;
+typedef struct TokenStream TokenStream;
+typedef struct Liveness Liveness;
 typedef struct Type Type;
 typedef struct Signature Signature;
 typedef struct Constant Constant;
@@ -36,13 +39,14 @@ typedef struct TypeContext TypeContext;
 
 typedef struct CfBlock CfBlock;
 typedef struct CfGraph CfGraph;
-typedef struct CfGraphFile CfGraphFile;
 typedef struct CfInstruction CfInstruction;
 
 
 struct CommandLineFlags {
     bool verbose;  // Whether to print a LOT of debug info
+    bool stats;  // Whether to print how much work was done for each function
     int optlevel;  // Optimization level (0 don't optimize, 3 optimize a lot)
+    bool keep_unused_functions;  // Whether to keep function definitions that main() never calls
 };
 
 
@@ -51,6 +55,44 @@ struct Location {
     int lineno;
 };
 
+/*
+Names of variables, functions, types, struct fields etc. are interned: each
+distinct name is stored only once, so two names are the same if and only if
+they are the same pointer. Interned names live until the compiler exits.
+*/
+void init_names();  // Called once when compiler starts
+const char *intern_name(const char *s);
+bool name_is_keyword(const char *name);  // name must be interned
+
+// Names that the compiler looks for, interned by init_names() so that they can be compared with ==.
+struct KnownNames {
+    const char *kw_def, *kw_declare, *kw_struct;
+    const char *kw_return, *kw_if, *kw_elif, *kw_else, *kw_while, *kw_for, *kw_break, *kw_continue;
+    const char *kw_True, *kw_False, *kw_NULL;
+    const char *kw_and, *kw_or, *kw_not, *kw_as;
+    const char *kw_void, *kw_bool, *kw_byte, *kw_int;
+    const char *main;
+};
+extern struct KnownNames known_names;  // kw_return is also the name of the return value variable
+
+/*
+Hash table that maps interned names to non-negative ints, usually indexes into
+a List. Zero-initialize to get an empty map. Clearing is O(1), so the same map
+can be reused for the local variables of every function.
+*/
+typedef struct NameMap NameMap;
+struct NameMap {
+    struct NameMapSlot *slots;
+    int capacity;  // zero or a power of two
+    int count;
+    unsigned generation;  // Slots left over from previous generations are empty
+};
+int namemap_get(const NameMap *map, const char *name);  // -1 if not found
+void namemap_set(NameMap *map, const char *name, int value);
+void namemap_clear(NameMap *map);
+void namemap_free(const NameMap *map);
+
+
 #ifdef __GNUC__
     void show_warning(Location location, const char *fmt, ...) __attribute__((format(printf,2,3)));
     noreturn void fail_with_error(Location location, const char *fmt, ...) __attribute__((format(printf,2,3)));
@@ -79,7 +121,7 @@ struct Token {
         char char_value;  // TOKEN_CHAR
         char *string_value;  // TOKEN_STRING
         int indentation_level;  // TOKEN_NEWLINE, indicates how many spaces after newline
-        char name[100];  // TOKEN_NAME and TOKEN_KEYWORD
+        const char *name;  // TOKEN_NAME and TOKEN_KEYWORD, interned
         char operator[4];  // TOKEN_OPERATOR
     } data;
 };
@@ -99,7 +141,7 @@ struct Constant {
         char *str;
     } data;
 };
-#define copy_constant(c) ( (c)->kind==CONSTANT_STRING ? (Constant){ CONSTANT_STRING, {.str=strdup((c)->data.str)} } : *(c) )
+#define copy_constant(arena, c) ( (c)->kind==CONSTANT_STRING ? (Constant){ CONSTANT_STRING, {.str=arena_strdup((arena), (c)->data.str)} } : *(c) )
 
 
 /*
@@ -113,29 +155,36 @@ It simply appears as a type with name "void".
 */
 struct AstType {
     Location location;
-    char name[100];
+    const char *name;
     int npointers;  // example: 2 means foo**
 };
 
 struct AstSignature {
     Location funcname_location;
-    char funcname[100];
+    const char *funcname;
     int nargs;
     AstType *argtypes;
-    char (*argnames)[100];
+    const char **argnames;
     bool takes_varargs;  // true for functions like printf()
     AstType returntype;  // can represent void
 };
 
 struct AstCall {
-    char calledname[100];  // e.g. function name of function call, struct name of instantiation
-    char (*argnames)[100];  // NULL when arguments are not named, e.g. function calls
-    AstExpression *args;
+    const char *calledname;  // e.g. function name of function call, struct name of instantiation
+    const char **argnames;  // NULL when arguments are not named, e.g. function calls
+    AstExpression **args;
     int nargs;
 };
 
+// Every expression gets these from the type checker.
+struct ExpressionTypes {
+    const Type *type;  // NULL for calls to "-> void" functions
+    const Type *type_after_cast;  // NULL for no implicit cast
+};
+
 struct AstExpression {
     Location location;
+    ExpressionTypes types;  // filled in by typecheck_function()
 
     enum AstExpressionKind {
         AST_EXPR_CONSTANT,
@@ -170,39 +219,34 @@ struct AstExpression {
     } kind;
     union {
         Constant constant;  // AST_EXPR_CONSTANT
-        char varname[100];  // AST_EXPR_GET_VARIABLE
+        const char *varname;  // AST_EXPR_GET_VARIABLE
         AstCall call;       // AST_EXPR_CALL, AST_EXPR_INSTANTIATE
-        struct { AstExpression *obj; char fieldname[100]; } field;  // AST_EXPR_GET_FIELD, AST_EXPR_DEREF_AND_GET_FIELD
+        struct { AstExpression *obj; const char *fieldname; } field;  // AST_EXPR_GET_FIELD, AST_EXPR_DEREF_AND_GET_FIELD
         struct { AstExpression *obj; AstType type; } as;
         /*
-        The "operands" pointer is an array of 1 to 2 expressions.
+        The "operands" are 1 or 2 expressions. The second is NULL for unary operators.
         A couple examples to hopefully give you an idea of how it works in general:
 
             * For AST_EXPR_DEREFERENCE, it is the dereferenced value: the "foo" of "*foo".
-            * For AST_EXPR_ADD, it is an array of the two things being added.
-            * For AST_EXPR_ASSIGN, these are the left and right side of the assignment.
+            * For AST_EXPR_ADD, these are the two things being added.
         */
-        AstExpression *operands;
+        AstExpression *operands[2];
     } data;
 };
 
 struct AstBody {
-    AstStatement *statements;
+    AstStatement **statements;
     int nstatements;
 };
 struct AstConditionAndBody {
-    AstExpression condition;
+    AstExpression *condition;
     AstBody body;
 };
 struct AstForLoop {
-    /*
-    for init; cond; incr:
-        ...body...
-
-    init and incr must be pointers because this struct goes inside AstStatement.
-    */
+    // for init; cond; incr:
+    //     ...body...
     AstStatement *init;
-    AstExpression cond;
+    AstExpression *cond;
     AstStatement *incr;
     AstBody body;
 };
@@ -213,14 +257,14 @@ struct AstIfStatement {
 };
 struct AstVarDeclaration {
     // name: type = initial_value
-    char name[100];
+    const char *name;
     AstType type;
     AstExpression *initial_value; // can be NULL
 };
 struct AstAssignment {
     // target = value
-    AstExpression target;
-    AstExpression value;
+    AstExpression *target;
+    AstExpression *value;
 };
 
 struct AstStatement {
@@ -238,7 +282,7 @@ struct AstStatement {
         AST_STMT_EXPRESSION_STATEMENT,  // Evaluate an expression and discard the result.
     } kind;
     union {
-        AstExpression expression;    // for AST_STMT_EXPRESSION_STATEMENT, AST_STMT_RETURN
+        AstExpression *expression;    // for AST_STMT_EXPRESSION_STATEMENT, AST_STMT_RETURN
         AstConditionAndBody whileloop;
         AstIfStatement ifstatement;
         AstForLoop forloop;
@@ -253,9 +297,9 @@ struct AstFunctionDef {
 };
 
 struct AstStructDef {
-    char name[100];
+    const char *name;
     int nfields;
-    char (*fieldnames)[100];
+    const char **fieldnames;
     AstType *fieldtypes;
 };
 
@@ -277,7 +321,6 @@ struct AstToplevelNode {
 
 
 struct Type {
-    char name[500];   // All types have a name for error messages and debugging.
     enum TypeKind {
         TYPE_SIGNED_INTEGER,
         TYPE_UNSIGNED_INTEGER,
@@ -289,7 +332,7 @@ struct Type {
     union {
         int width_in_bits;  // TYPE_SIGNED_INTEGER, TYPE_UNSIGNED_INTEGER
         const Type *valuetype;  // TYPE_POINTER
-        struct { int count; char (*names)[100]; const Type **types; } structfields;  // TYPE_STRUCT
+        struct { int count; const char **names; const Type **types; NameMap indexes; } structfields;  // TYPE_STRUCT
     } data;
 };
 
@@ -305,7 +348,8 @@ can simply use "==" between two "const Type *" pointers.
 Struct types are a bit different. When you make a struct, you get a
 pointer that you must pass to free_type() later. You can still "=="
 compare types, because two different structs with the same members are
-not the same type.
+not the same type. Freeing a struct also frees the types built from it,
+such as pointers to the struct.
 */
 extern const Type *boolType;      // bool
 extern const Type *intType;       // int (32-bit signed)
@@ -314,22 +358,25 @@ extern const Type *voidPtrType;   // void*
 void init_types();  // Called once when compiler starts
 const Type *get_integer_type(int size_in_bits, bool is_signed);
 const Type *get_pointer_type(const Type *t);  // result lives as long as t
+const char *type_name(const Type *t);  // for error messages and debugging, lives as long as t
 const Type *type_of_constant(const Constant *c);
 Type *create_struct(
     const char *name,
     int fieldcount,
-    char (*fieldnames)[100],  // will be free()d eventually
+    const char **fieldnames,  // will be free()d eventually
     const Type **fieldtypes);  // will be free()d eventually
 void free_type(Type *type);
+int find_struct_field(const Type *structtype, const char *fieldname);  // -1 if not found
+LLVMTypeRef *get_llvm_type_cache(const Type *t);  // codegen stores the LLVM type here, initially NULL
 
 bool is_integer_type(const Type *t);  // includes signed and unsigned
 bool is_pointer_type(const Type *t);  // includes void pointers
 
 struct Signature {
-    char funcname[100];
+    const char *funcname;
     int nargs;
     const Type **argtypes;
-    char (*argnames)[100];
+    const char **argnames;
     bool takes_varargs;  // true for functions like printf()
     const Type *returntype;  // NULL, if does not return a value
     Location returntype_location;  // meaningful even if returntype is NULL
@@ -341,28 +388,25 @@ Signature copy_signature(const Signature *sig);
 
 struct Variable {
     int id;  // Unique, but you can also compare pointers to Variable.
-    char name[100];  // Same name as in user's code, empty for temporary variables created by compiler
+    const char *name;  // Same name as in user's code, NULL for temporary variables created by compiler
     const Type *type;
     bool is_argument;    // First n variables are always the arguments
 };
 
-struct ExpressionTypes {
-    const AstExpression *expr;
-    const Type *type;
-    const Type *type_after_cast;  // NULL for no implicit cast
-};
 struct TypeContext {
+    Arena *arena;  // Variables of the current function live here, along with its control flow graph
     const Signature *current_function_signature;
-    // expr_types tells what type each expression has.
-    // It contains nothing for calls to "-> void" functions.
-    List(ExpressionTypes *) expr_types;
     List(Variable *) variables;
     List(Type *) structs;
     List(Signature) function_signatures;
+    // Map names to indexes in the above lists.
+    // variable_indexes only contains variables that have a name.
+    NameMap variable_indexes, struct_indexes, function_indexes;
 };
 
 // function body can be NULL to check a declaration
-void typecheck_function(TypeContext *ctx, Location funcname_location, const AstSignature *astsig, const AstBody *body);
+// Returns the new signature. It is valid until the next typecheck_function() call.
+const Signature *typecheck_function(TypeContext *ctx, Location funcname_location, const AstSignature *astsig, AstBody *body);
 void typecheck_struct(TypeContext *ctx, const AstStructDef *structdef, Location location);
 
 /*
@@ -381,8 +425,16 @@ void destroy_type_context(const TypeContext *ctx);
 
 // Control Flow Graph.
 // Struct names not prefixed with Cfg because it looks too much like "config" to me
+// Fields are ordered so that there is as little padding as possible.
 struct CfInstruction {
     Location location;
+    union CfInstructionData {
+        Constant constant;      // CF_CONSTANT
+        struct { const char *funcname; int funcindex; } call;  // CF_CALL, funcindex is index in TypeContext.function_signatures
+        struct { const char *fieldname; int fieldindex; } field;  // CF_PTR_STRUCT_FIELD
+    } data;
+    const Variable **operands;  // e.g. numbers to add, function arguments
+    const Variable *destvar;  // NULL when it doesn't make sense, e.g. functions that return void
     enum CfInstructionKind {
         CF_CONSTANT,
         CF_CALL,
@@ -403,20 +455,16 @@ struct CfInstruction {
         CF_INT_LT,
         CF_INT_CAST,
         CF_BOOL_NEGATE,  // TODO: get rid of this?
+        CF_BOOL_AND,  // unlike the "and" keyword, always evaluates both operands
+        CF_BOOL_OR,  // unlike the "or" keyword, always evaluates both operands
         CF_VARCPY, // similar to assignment statements: var1 = var2
     } kind;
-    union CfInstructionData {
-        Constant constant;      // CF_CONSTANT
-        char funcname[100];     // CF_CALL
-        char fieldname[100];    // CF_PTR_STRUCT_FIELD
-    } data;
-    const Variable **operands;  // e.g. numbers to add, function arguments
     int noperands;
-    const Variable *destvar;  // NULL when it doesn't make sense, e.g. functions that return void
     bool hide_unreachable_warning; // usually false, can be set to true to avoid unreachable warning false positives
 };
 
 struct CfBlock {
+    int id;  // Unique within the function. Same as index in all_blocks, except while simplify_cfg.c is removing blocks.
     List(CfInstruction) instructions;
     const Variable *branchvar;  // boolean value used to decide where to jump next
     CfBlock *iftrue;
@@ -428,53 +476,91 @@ struct CfGraph {
     CfBlock end_block;  // Always empty. Return statement jumps here.
     List(CfBlock *) all_blocks;
     List(Variable *) variables;   // First n variables are the function arguments
+    Arena *arena;  // The graph lives here, so that simplify_cfg.c can allocate instructions
 };
 
-struct CfGraphFile {
-    TypeContext typectx;
-    const char *filename;
-    int nfuncs;
-    Signature *signatures;
-    CfGraph **graphs;  // NULL means function is only declared, not defined
+// Counters for --stats. Each compilation step adds to these.
+struct FunctionStats {
+    int var_status_analyses;  // How many times variable statuses were determined from scratch
+    int fixpoint_iterations;  // How many times a block was analyzed in those analyses
+    int stack_bytes;  // Size of stack space for variables whose address is taken
+    int stack_bytes_without_sharing;  // Same, if each variable had separate stack space
 };
 
-
 /*
 The compiling functions, i.e. how to go from source code to LLVM IR and
 eventually running the LLVM IR. Each function's result is fed into the next.
 
-Make sure that the filename passed to tokenize() stays alive throughout the
-entire compilation. It is used in error messages.
+The compiler works on one top-level definition at a time: it is parsed,
+typechecked, turned into a control flow graph and then into LLVM IR, before
+the next definition is even tokenized. This way, compiling a big file doesn't
+need the tokens, ASTs or control flow graphs of the whole file at once.
+
+Make sure that the filename passed to open_token_stream() stays alive throughout
+the entire compilation. It is used in error messages.
+
+The token stream gives the parser the tokens of one top-level definition at a
+time. The parser must call unread_tokens() with the first token that it didn't
+use, usually the last token, because read_toplevel_tokens() returns one token
+after the definition to show in error messages. The tokenize() function reads
+all tokens into an array, and is used only to show them with --verbose.
+
+The results of tokenize(), parse_toplevel_node() and build_control_flow_graph()
+are allocated from the given arena. To free them, use arena_free() when the
+next step no longer needs them.
 */
-Token *tokenize(const char *filename);
-AstToplevelNode *parse(const Token *tokens);
-CfGraphFile build_control_flow_graphs(AstToplevelNode *ast);
-void simplify_control_flow_graphs(const CfGraphFile *cfgfile);
-LLVMModuleRef codegen(const CfGraphFile *cfgfile);
+TokenStream *open_token_stream(const char *filename);
+const Token *read_toplevel_tokens(TokenStream *ts);
+void unread_tokens(TokenStream *ts, const Token *first_unused);
+void close_token_stream(TokenStream *ts);
+Token *tokenize(const char *filename, Arena *arena);
+AstToplevelNode parse_toplevel_node(TokenStream *ts, Arena *arena);  // returns AST_TOPLEVEL_END_OF_FILE at end
+CfGraph *build_control_flow_graph(TypeContext *typectx, const AstBody *body);  // call after typecheck_function()
+void simplify_control_flow_graph(CfGraph *cfg, const Signature *sig, FunctionStats *stats);
+LLVMModuleRef codegen_create_module(const char *filename);
+void codegen_function(LLVMModuleRef module, const Signature *sig, const CfGraph *cfg, FunctionStats *stats);  // cfg=NULL for declarations
+void codegen_remove_unused_functions(LLVMModuleRef module);  // call after all functions, removes definitions main() doesn't need
 int run_program(LLVMModuleRef module, const CommandLineFlags *flags);  // destroys the module
 
+void free_signature(const Signature *sig);
+
 /*
-Use these to clean up return values of compiling functions.
+Liveness analysis: a variable is live at some point of a function, if the
+value it has at that point may be read later. Variables whose address is
+taken are always live, because they can be read through a pointer.
+
+The result becomes invalid when the function's blocks, jumps or instructions
+are changed. remove_dead_instructions() uses this to delete instructions whose
+results are never read, except that function calls are kept and only their
+return value is thrown away.
+*/
+Liveness *compute_liveness(const CfGraph *cfg);
+bool is_live_at_start_of_block(const Liveness *lv, const CfBlock *b, const Variable *v);
+bool is_live_at_end_of_block(const Liveness *lv, const CfBlock *b, const Variable *v);
+// Writes variables live at start of b to result, except those whose address is taken. Returns how many.
+int list_live_variables_at_start_of_block(const Liveness *lv, const CfBlock *b, const Variable **result);
+void free_liveness(Liveness *lv);
+void remove_dead_instructions(CfGraph *cfg);
 
-Even though arrays are typically allocated with malloc(), you shouldn't simply
-free() them. For example, free(topnodelist) would free the list of AST nodes,
-but not any of the data contained within individual nodes.
+/*
+Variables whose address is taken need stack space. Variables of the same type
+can share it, if they don't contain needed values at the same time. Returns a
+malloc()ed array indexed by Variable.id: for each variable whose address is
+taken, the variable whose stack space it uses (possibly itself), and NULL for
+other variables.
 */
-void free_constant(const Constant *c);
-void free_tokens(Token *tokenlist);
-void free_ast(AstToplevelNode *topnodelist);
-void free_control_flow_graphs(const CfGraphFile *cfgfile);
-void free_control_flow_graph_block(const CfGraph *cfg, CfBlock *b);
+const Variable **assign_stack_slots(const CfGraph *cfg);
 
 /*
 Functions for printing intermediate data for debugging and exploring the compiler.
-Most of these take the data for an entire program.
+Most of these take the data for one top-level definition.
 */
 void print_token(const Token *token);
 void print_tokens(const Token *tokenlist);
-void print_ast(const AstToplevelNode *topnodelist);
+void print_ast(const AstToplevelNode *topnode);
 void print_control_flow_graph(const CfGraph *cfg);
-void print_control_flow_graphs(const CfGraphFile *cfgfile);
+void print_function_control_flow_graph(const Signature *sig, const CfGraph *cfg);
+void print_function_stats(const Signature *sig, const FunctionStats *stats);
 void print_llvm_ir(LLVMModuleRef module);
 
 #endif
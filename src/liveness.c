@@ -0,0 +1,622 @@
+// Liveness analysis, removing instructions whose results are never used, and
+// sharing stack space between variables.
+
+#include "jou_compiler.h"
+#include <stdint.h>
+
+typedef uint64_t LiveWord;
+#define BITS_PER_WORD 64
+
+/*
+Most variables are temporaries that are set and used within the same block.
+They are never live at the start or end of a block, so the sets stored for
+each block only contain the other variables, which are given the smallest
+bit numbers. Sets used while going through the instructions of one block
+contain all variables.
+*/
+struct Liveness {
+    int nvars;
+    int nbits_per_block;  // variables that can be live between blocks have bits 0,1,...,nbits_per_block-1
+    int nwords_per_block;
+    int nwords_all;  // enough words for all variables
+    int *bits_by_id;  // bit number of each variable
+    const Variable **vars_by_bit;
+    int *block_indexes_by_id;
+    bool *always_live;  // indexed by bit number
+    LiveWord *live_in;  // nwords_per_block for each block, one after another
+    LiveWord *live_out;
+};
+
+static bool get_bit(const LiveWord *set, int i)
+{
+    return (set[i / BITS_PER_WORD] >> (i % BITS_PER_WORD)) & 1;
+}
+
+static void set_bit(LiveWord *set, int i, bool value)
+{
+    LiveWord bit = (LiveWord)1 << (i % BITS_PER_WORD);
+    if (value)
+        set[i / BITS_PER_WORD] |= bit;
+    else
+        set[i / BITS_PER_WORD] &= ~bit;
+}
+
+// Figure out how an instruction affects liveness, going backwards.
+static void update_live_set(const Liveness *lv, LiveWord *live, const CfInstruction *ins)
+{
+    if (ins->destvar) {
+        int dest = lv->bits_by_id[ins->destvar->id];
+        if (!lv->always_live[dest])
+            set_bit(live, dest, false);
+    }
+    for (int i = 0; i < ins->noperands; i++)
+        set_bit(live, lv->bits_by_id[ins->operands[i]->id], true);
+}
+
+// Variables that are live at the end of a block, before looking at the jump condition.
+static void get_live_set_at_end(const CfGraph *cfg, const Liveness *lv, int blockidx, LiveWord *live)
+{
+    const CfBlock *b = cfg->all_blocks.ptr[blockidx];
+    // Other bits are already zero, because variables not stored for each block are never live at the end of a block.
+    memcpy(live, &lv->live_out[(size_t)blockidx * lv->nwords_per_block], sizeof(live[0]) * lv->nwords_per_block);
+    if (b != &cfg->end_block && b->iftrue != b->iffalse)
+        set_bit(live, lv->bits_by_id[b->branchvar->id], true);
+}
+
+Liveness *compute_liveness(const CfGraph *cfg)
+{
+    int nblocks = cfg->all_blocks.len;
+    Liveness *lv = calloc(1, sizeof *lv);
+    lv->nvars = cfg->variables.len;
+
+    int maxid = -1;
+    for (int i = 0; i < nblocks; i++)
+        maxid = max(maxid, cfg->all_blocks.ptr[i]->id);
+    lv->block_indexes_by_id = malloc(sizeof(lv->block_indexes_by_id[0]) * (maxid + 1));  // NOLINT
+    for (int i = 0; i < nblocks; i++)
+        lv->block_indexes_by_id[cfg->all_blocks.ptr[i]->id] = i;
+
+    maxid = -1;
+    for (int i = 0; i < lv->nvars; i++)
+        maxid = max(maxid, cfg->variables.ptr[i]->id);
+
+    /*
+    Find variables that can be live between blocks: those that a block uses
+    before setting them. The return value is used when the function returns.
+    Variables whose address is taken are always live.
+    */
+    bool *between_blocks = calloc(sizeof(between_blocks[0]), maxid + 1);
+    int *last_set_in_block = malloc(sizeof(last_set_in_block[0]) * (maxid + 1));  // NOLINT
+    for (int i = 0; i < lv->nvars; i++) {
+        last_set_in_block[cfg->variables.ptr[i]->id] = -1;
+        if (cfg->variables.ptr[i]->name == known_names.kw_return)
+            between_blocks[cfg->variables.ptr[i]->id] = true;
+    }
+    for (int blockidx = 0; blockidx < nblocks; blockidx++) {
+        const CfBlock *b = cfg->all_blocks.ptr[blockidx];
+        for (const CfInstruction *ins = b->instructions.ptr; ins < End(b->instructions); ins++) {
+            for (int i = 0; i < ins->noperands; i++)
+                if (last_set_in_block[ins->operands[i]->id] != blockidx || ins->kind == CF_ADDRESS_OF_VARIABLE)
+                    between_blocks[ins->operands[i]->id] = true;
+            if (ins->destvar)
+                last_set_in_block[ins->destvar->id] = blockidx;
+        }
+        if (b != &cfg->end_block && b->iftrue != b->iffalse && last_set_in_block[b->branchvar->id] != blockidx)
+            between_blocks[b->branchvar->id] = true;
+    }
+
+    lv->bits_by_id = malloc(sizeof(lv->bits_by_id[0]) * (maxid + 1));  // NOLINT
+    lv->vars_by_bit = malloc(sizeof(lv->vars_by_bit[0]) * (lv->nvars + 1));  // NOLINT
+    int nbits = 0;
+    for (int k = 0; k < 2; k++) {
+        for (int i = 0; i < lv->nvars; i++) {
+            int id = cfg->variables.ptr[i]->id;
+            if (between_blocks[id] == (k == 0)) {
+                lv->vars_by_bit[nbits] = cfg->variables.ptr[i];
+                lv->bits_by_id[id] = nbits++;
+            }
+        }
+        if (k == 0) {
+            lv->nbits_per_block = nbits;
+            lv->nwords_per_block = nbits / BITS_PER_WORD + 1;
+        }
+    }
+    lv->nwords_all = nbits / BITS_PER_WORD + 1;
+    free(between_blocks);
+    free(last_set_in_block);
+
+    // Variables can be read through pointers at any time, so we don't know when they are used.
+    lv->always_live = calloc(sizeof(lv->always_live[0]), lv->nvars + 1);
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++)
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++)
+            if (ins->kind == CF_ADDRESS_OF_VARIABLE)
+                lv->always_live[lv->bits_by_id[ins->operands[0]->id]] = true;
+
+    size_t nwords_total = (size_t)nblocks * lv->nwords_per_block;
+    lv->live_in = calloc(sizeof(lv->live_in[0]), nwords_total);
+    lv->live_out = calloc(sizeof(lv->live_out[0]), nwords_total);
+
+    int end_block_index = lv->block_indexes_by_id[cfg->end_block.id];
+    for (int i = 0; i < lv->nvars; i++)
+        if (cfg->variables.ptr[i]->name == known_names.kw_return)
+            set_bit(&lv->live_in[(size_t)end_block_index * lv->nwords_per_block], lv->bits_by_id[cfg->variables.ptr[i]->id], true);
+
+    /*
+    Going backwards makes this converge quickly, because blocks are mostly
+    created in the order they appear in the code. Loops need more passes.
+    */
+    LiveWord *temp = calloc(sizeof(temp[0]), lv->nwords_all);
+    bool changed;
+    do {
+        changed = false;
+        for (int blockidx = nblocks - 1; blockidx >= 0; blockidx--) {
+            const CfBlock *b = cfg->all_blocks.ptr[blockidx];
+            LiveWord *out = &lv->live_out[(size_t)blockidx * lv->nwords_per_block];
+            if (b != &cfg->end_block) {
+                for (int k = 0; k < 2; k++) {
+                    int succ = lv->block_indexes_by_id[(k ? b->iffalse : b->iftrue)->id];
+                    const LiveWord *in = &lv->live_in[(size_t)succ * lv->nwords_per_block];
+                    for (int w = 0; w < lv->nwords_per_block; w++)
+                        out[w] |= in[w];
+                }
+            }
+
+            get_live_set_at_end(cfg, lv, blockidx, temp);
+            for (int i = b->instructions.len - 1; i >= 0; i--)
+                update_live_set(lv, temp, &b->instructions.ptr[i]);
+
+            LiveWord *in = &lv->live_in[(size_t)blockidx * lv->nwords_per_block];
+            for (int w = 0; w < lv->nwords_per_block; w++) {
+                if (temp[w] & ~in[w]) {
+                    in[w] |= temp[w];
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+
+    free(temp);
+    return lv;
+}
+
+void free_liveness(Liveness *lv)
+{
+    free(lv->bits_by_id);
+    free(lv->vars_by_bit);
+    free(lv->block_indexes_by_id);
+    free(lv->always_live);
+    free(lv->live_in);
+    free(lv->live_out);
+    free(lv);
+}
+
+bool is_live_at_start_of_block(const Liveness *lv, const CfBlock *b, const Variable *v)
+{
+    int blockidx = lv->block_indexes_by_id[b->id];
+    int bit = lv->bits_by_id[v->id];
+    return lv->always_live[bit] || (bit < lv->nbits_per_block && get_bit(&lv->live_in[(size_t)blockidx * lv->nwords_per_block], bit));
+}
+
+bool is_live_at_end_of_block(const Liveness *lv, const CfBlock *b, const Variable *v)
+{
+    int blockidx = lv->block_indexes_by_id[b->id];
+    int bit = lv->bits_by_id[v->id];
+    return lv->always_live[bit] || (bit < lv->nbits_per_block && get_bit(&lv->live_out[(size_t)blockidx * lv->nwords_per_block], bit));
+}
+
+int list_live_variables_at_start_of_block(const Liveness *lv, const CfBlock *b, const Variable **result)
+{
+    const LiveWord *in = &lv->live_in[(size_t)lv->block_indexes_by_id[b->id] * lv->nwords_per_block];
+    int n = 0;
+    for (int w = 0; w < lv->nwords_per_block; w++) {
+        if (in[w] == 0)
+            continue;
+        for (int bit = w*BITS_PER_WORD; bit < (w+1)*BITS_PER_WORD && bit < lv->nbits_per_block; bit++)
+            if (get_bit(in, bit) && !lv->always_live[bit])
+                result[n++] = lv->vars_by_bit[bit];
+    }
+    return n;
+}
+
+static bool has_side_effects(const CfInstruction *ins)
+{
+    switch(ins->kind) {
+    case CF_CALL:
+    case CF_PTR_STORE:
+    case CF_PTR_MEMSET_TO_ZERO:
+        return true;
+    case CF_CONSTANT:
+    case CF_ADDRESS_OF_VARIABLE:
+    case CF_PTR_LOAD:
+    case CF_PTR_EQ:
+    case CF_PTR_STRUCT_FIELD:
+    case CF_PTR_CAST:
+    case CF_PTR_ADD_INT:
+    case CF_INT_ADD:
+    case CF_INT_SUB:
+    case CF_INT_MUL:
+    case CF_INT_SDIV:
+    case CF_INT_UDIV:
+    case CF_INT_EQ:
+    case CF_INT_LT:
+    case CF_INT_CAST:
+    case CF_BOOL_NEGATE:
+    case CF_BOOL_AND:
+    case CF_BOOL_OR:
+    case CF_VARCPY:
+        return false;
+    }
+    assert(0);
+}
+
+// Returns number of instructions removed.
+static int remove_dead_instructions_once(CfGraph *cfg)
+{
+    Liveness *lv = compute_liveness(cfg);
+    LiveWord *live = calloc(sizeof(live[0]), lv->nwords_all);
+    int nremoved = 0;
+
+    for (int blockidx = 0; blockidx < cfg->all_blocks.len; blockidx++) {
+        CfBlock *b = cfg->all_blocks.ptr[blockidx];
+        get_live_set_at_end(cfg, lv, blockidx, live);
+
+        // Walk backwards, moving the instructions that stay to the end of the block.
+        int nkept = 0;
+        for (int i = b->instructions.len - 1; i >= 0; i--) {
+            CfInstruction *ins = &b->instructions.ptr[i];
+            if (ins->destvar) {
+                int dest = lv->bits_by_id[ins->destvar->id];
+                if (!lv->always_live[dest] && !get_bit(live, dest)) {
+                    if (!has_side_effects(ins)) {
+                        nremoved++;
+                        continue;
+                    }
+                    // Function is called for its side effects, but the return value is not needed.
+                    ins->destvar = NULL;
+                }
+            }
+            update_live_set(lv, live, ins);
+            b->instructions.ptr[b->instructions.len - ++nkept] = *ins;
+        }
+
+        if (nkept != b->instructions.len) {
+            memmove(b->instructions.ptr, End(b->instructions) - nkept, sizeof(b->instructions.ptr[0]) * nkept);
+            b->instructions.len = nkept;
+        }
+    }
+
+    free(live);
+    free_liveness(lv);
+    return nremoved;
+}
+
+void remove_dead_instructions(CfGraph *cfg)
+{
+    // Removing an instruction can make the instructions that computed its operands dead too.
+    while (remove_dead_instructions_once(cfg) != 0)
+        ;
+}
+
+/*
+Variables whose address is taken live in stack space. Two variables of the
+same type can use the same stack space, if they never contain a value that
+will be needed later at the same time. This is like liveness above, except
+that variables are also read and written through pointers.
+
+If a pointer to a variable is used for anything else than loading and
+storing, for example passed to a function, then the variable gets its own
+stack space, because we don't know when the pointer will be used.
+*/
+struct SlotState {
+    const CfGraph *cfg;
+    int *candidates_by_id;  // index in candidates array, or -1 if address is not taken
+    int *pointees_by_id;  // for pointer variables, candidate index of the variable they point into, or -1
+    bool *whole_by_id;  // true if variable points to the start of the whole pointee, not into a field
+    List(const Variable *) candidates;
+    bool *escaped;  // indexed by candidate index
+};
+
+struct Access {
+    int candidate;
+    bool overwrites;  // false means that the value is read, or only a part of it is written
+};
+
+static bool derives_pointer(const CfInstruction *ins)
+{
+    switch(ins->kind) {
+    case CF_ADDRESS_OF_VARIABLE:
+    case CF_PTR_STRUCT_FIELD:
+    case CF_PTR_CAST:
+    case CF_PTR_ADD_INT:
+    case CF_VARCPY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void find_pointees(struct SlotState *ss, int maxid)
+{
+    int *ndefs = calloc(sizeof(ndefs[0]), maxid + 1);
+    for (CfBlock **b = ss->cfg->all_blocks.ptr; b < End(ss->cfg->all_blocks); b++)
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++)
+            if (ins->destvar)
+                ndefs[ins->destvar->id]++;
+
+    // Loops can use a pointer before the instruction that creates it, so repeat until nothing changes.
+    bool changed;
+    do {
+        changed = false;
+        for (CfBlock **b = ss->cfg->all_blocks.ptr; b < End(ss->cfg->all_blocks); b++) {
+            for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++) {
+                if (!derives_pointer(ins) || ss->pointees_by_id[ins->destvar->id] != -1)
+                    continue;
+                int pointee = ins->kind == CF_ADDRESS_OF_VARIABLE
+                    ? ss->candidates_by_id[ins->operands[0]->id]
+                    : ss->pointees_by_id[ins->operands[0]->id];
+                if (pointee == -1)
+                    continue;
+
+                ss->pointees_by_id[ins->destvar->id] = pointee;
+                ss->whole_by_id[ins->destvar->id] = ins->kind == CF_ADDRESS_OF_VARIABLE
+                    || (ins->kind == CF_VARCPY && ss->whole_by_id[ins->operands[0]->id]);
+                changed = true;
+
+                // Pointer stored into a variable that can be accessed in other ways, or set in many places.
+                if (ndefs[ins->destvar->id] != 1
+                    || ss->candidates_by_id[ins->destvar->id] != -1
+                    || ins->destvar->name == known_names.kw_return)
+                {
+                    ss->escaped[pointee] = true;
+                }
+            }
+        }
+    } while (changed);
+    free(ndefs);
+
+    for (CfBlock **b = ss->cfg->all_blocks.ptr; b < End(ss->cfg->all_blocks); b++) {
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++) {
+            for (int i = 0; i < ins->noperands; i++) {
+                int pointee = ss->pointees_by_id[ins->operands[i]->id];
+                if (pointee == -1)
+                    continue;
+                bool ok = i == 0 && (
+                    derives_pointer(ins)
+                    || ins->kind == CF_PTR_LOAD
+                    || ins->kind == CF_PTR_STORE
+                    || ins->kind == CF_PTR_MEMSET_TO_ZERO);
+                if (!ok)
+                    ss->escaped[pointee] = true;
+            }
+        }
+    }
+}
+
+// Returns number of accesses written to result. Result must have room for noperands+1 accesses.
+static int get_accesses(const struct SlotState *ss, const CfInstruction *ins, struct Access *result)
+{
+    int n = 0;
+
+    if (ins->kind == CF_PTR_LOAD || ins->kind == CF_PTR_STORE || ins->kind == CF_PTR_MEMSET_TO_ZERO) {
+        const Variable *ptr = ins->operands[0];
+        int pointee = ss->pointees_by_id[ptr->id];
+        if (pointee != -1) {
+            bool overwrites = ins->kind == CF_PTR_MEMSET_TO_ZERO && ss->whole_by_id[ptr->id];
+            result[n++] = (struct Access){ pointee, overwrites };
+        }
+    }
+
+    // Taking the address of a variable doesn't access the value.
+    if (ins->kind != CF_ADDRESS_OF_VARIABLE) {
+        for (int i = 0; i < ins->noperands; i++) {
+            int c = ss->candidates_by_id[ins->operands[i]->id];
+            if (c != -1)
+                result[n++] = (struct Access){ c, false };
+        }
+    }
+
+    if (ins->destvar && ss->candidates_by_id[ins->destvar->id] != -1)
+        result[n++] = (struct Access){ ss->candidates_by_id[ins->destvar->id], true };
+
+    return n;
+}
+
+// Going backwards through an instruction, like update_live_set().
+static void update_live_candidates(const struct Access *accesses, int naccesses, LiveWord *live)
+{
+    for (int i = 0; i < naccesses; i++)
+        if (accesses[i].overwrites)
+            set_bit(live, accesses[i].candidate, false);
+    for (int i = 0; i < naccesses; i++)
+        if (!accesses[i].overwrites)
+            set_bit(live, accesses[i].candidate, true);
+}
+
+static void add_interference(LiveWord *interference, int nwords, int candidate, const LiveWord *live)
+{
+    for (int w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int other = w*BITS_PER_WORD; other < (w+1)*BITS_PER_WORD; other++) {
+            if (other != candidate && get_bit(live, other)) {
+                set_bit(&interference[(size_t)candidate * nwords], other, true);
+                set_bit(&interference[(size_t)other * nwords], candidate, true);
+            }
+        }
+    }
+}
+
+static LiveWord *compute_interference(const struct SlotState *ss, int nwords)
+{
+    const CfGraph *cfg = ss->cfg;
+    int nblocks = cfg->all_blocks.len;
+    int ncand = ss->candidates.len;
+
+    int maxops = 0;
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++)
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++)
+            maxops = max(maxops, ins->noperands);
+    struct Access *accesses = malloc(sizeof(accesses[0]) * (maxops + 2));  // NOLINT
+
+    // Candidates live at start of each block, and the block indexes of jump targets.
+    LiveWord *live_in = calloc(sizeof(live_in[0]), (size_t)nblocks * nwords);
+    int maxblockid = -1;
+    for (int i = 0; i < nblocks; i++)
+        maxblockid = max(maxblockid, cfg->all_blocks.ptr[i]->id);
+    int *block_indexes_by_id = malloc(sizeof(block_indexes_by_id[0]) * (maxblockid + 1));  // NOLINT
+    for (int i = 0; i < nblocks; i++)
+        block_indexes_by_id[cfg->all_blocks.ptr[i]->id] = i;
+    int *succ = malloc(sizeof(succ[0]) * 2 * nblocks);  // NOLINT
+    for (int i = 0; i < nblocks; i++) {
+        const CfBlock *b = cfg->all_blocks.ptr[i];
+        for (int k = 0; k < 2; k++)
+            succ[2*i + k] = b == &cfg->end_block ? -1 : block_indexes_by_id[(k ? b->iffalse : b->iftrue)->id];
+    }
+    free(block_indexes_by_id);
+
+    LiveWord *live = malloc(sizeof(live[0]) * nwords);  // NOLINT
+    bool changed;
+    do {
+        changed = false;
+        for (int blockidx = nblocks - 1; blockidx >= 0; blockidx--) {
+            const CfBlock *b = cfg->all_blocks.ptr[blockidx];
+            memset(live, 0, sizeof(live[0]) * nwords);
+            for (int k = 0; k < 2; k++)
+                if (succ[2*blockidx + k] != -1)
+                    for (int w = 0; w < nwords; w++)
+                        live[w] |= live_in[(size_t)succ[2*blockidx + k] * nwords + w];
+            if (b != &cfg->end_block && b->iftrue != b->iffalse && ss->candidates_by_id[b->branchvar->id] != -1)
+                set_bit(live, ss->candidates_by_id[b->branchvar->id], true);
+
+            for (int i = b->instructions.len - 1; i >= 0; i--) {
+                int n = get_accesses(ss, &b->instructions.ptr[i], accesses);
+                update_live_candidates(accesses, n, live);
+            }
+
+            LiveWord *in = &live_in[(size_t)blockidx * nwords];
+            for (int w = 0; w < nwords; w++) {
+                if (live[w] & ~in[w]) {
+                    in[w] |= live[w];
+                    changed = true;
+                }
+            }
+        }
+    } while (changed);
+
+    /*
+    If two variables contain needed values at the same time, then one of them
+    is written while the other is live, or both are live when the function starts.
+    */
+    LiveWord *interference = calloc(sizeof(interference[0]), (size_t)ncand * nwords);
+    for (int blockidx = 0; blockidx < nblocks; blockidx++) {
+        const CfBlock *b = cfg->all_blocks.ptr[blockidx];
+        memset(live, 0, sizeof(live[0]) * nwords);
+        for (int k = 0; k < 2; k++)
+            if (succ[2*blockidx + k] != -1)
+                for (int w = 0; w < nwords; w++)
+                    live[w] |= live_in[(size_t)succ[2*blockidx + k] * nwords + w];
+        if (b != &cfg->end_block && b->iftrue != b->iffalse && ss->candidates_by_id[b->branchvar->id] != -1)
+            set_bit(live, ss->candidates_by_id[b->branchvar->id], true);
+
+        for (int i = b->instructions.len - 1; i >= 0; i--) {
+            const CfInstruction *ins = &b->instructions.ptr[i];
+            int n = get_accesses(ss, ins, accesses);
+            for (int k = 0; k < n; k++) {
+                // Storing to a part of a variable also writes.
+                if (accesses[k].overwrites || ins->kind == CF_PTR_STORE || ins->kind == CF_PTR_MEMSET_TO_ZERO)
+                    add_interference(interference, nwords, accesses[k].candidate, live);
+            }
+            update_live_candidates(accesses, n, live);
+        }
+    }
+    for (int c = 0; c < ncand; c++)
+        if (get_bit(live_in, c))
+            add_interference(interference, nwords, c, live_in);
+
+    free(accesses);
+    free(live_in);
+    free(succ);
+    free(live);
+    return interference;
+}
+
+const Variable **assign_stack_slots(const CfGraph *cfg)
+{
+    int maxid = -1;
+    for (int i = 0; i < cfg->variables.len; i++)
+        maxid = max(maxid, cfg->variables.ptr[i]->id);
+
+    struct SlotState ss = { .cfg = cfg };
+    ss.candidates_by_id = malloc(sizeof(ss.candidates_by_id[0]) * (maxid + 1));  // NOLINT
+    ss.pointees_by_id = malloc(sizeof(ss.pointees_by_id[0]) * (maxid + 1));  // NOLINT
+    ss.whole_by_id = calloc(sizeof(ss.whole_by_id[0]), maxid + 1);
+    for (int id = 0; id <= maxid; id++)
+        ss.candidates_by_id[id] = ss.pointees_by_id[id] = -1;
+
+    const Variable **result = calloc(sizeof(result[0]), maxid + 1);
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++) {
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++) {
+            if (ins->kind == CF_ADDRESS_OF_VARIABLE && !result[ins->operands[0]->id]) {
+                result[ins->operands[0]->id] = ins->operands[0];
+            }
+        }
+    }
+    // Same order as the variables, so that the first variable of each slot is allocated first.
+    for (int i = 0; i < cfg->variables.len; i++) {
+        const Variable *v = cfg->variables.ptr[i];
+        if (result[v->id]) {
+            ss.candidates_by_id[v->id] = ss.candidates.len;
+            Append(&ss.candidates, v);
+        }
+    }
+
+    int ncand = ss.candidates.len;
+    if (ncand >= 2) {
+        ss.escaped = calloc(sizeof(ss.escaped[0]), ncand);
+        find_pointees(&ss, maxid);
+
+        int nwords = ncand / BITS_PER_WORD + 1;
+        LiveWord *interference = compute_interference(&ss, nwords);
+
+        // Greedy coloring: put each variable into the first slot where it fits.
+        List(int) slots = {0};  // candidate index of the first variable in each slot
+        LiveWord *members = NULL;  // nwords for each slot
+        for (int c = 0; c < ncand; c++) {
+            const Variable *v = ss.candidates.ptr[c];
+            if (ss.escaped[c])
+                continue;
+
+            int s;
+            for (s = 0; s < slots.len; s++) {
+                if (ss.candidates.ptr[slots.ptr[s]]->type != v->type)
+                    continue;
+                const LiveWord *m = &members[(size_t)s * nwords];
+                const LiveWord *row = &interference[(size_t)c * nwords];
+                int w = 0;
+                while (w < nwords && !(m[w] & row[w]))
+                    w++;
+                if (w == nwords)
+                    break;
+            }
+
+            if (s == slots.len) {
+                Append(&slots, c);
+                members = realloc(members, sizeof(members[0]) * slots.len * nwords);
+                memset(&members[(size_t)s * nwords], 0, sizeof(members[0]) * nwords);
+            }
+            set_bit(&members[(size_t)s * nwords], c, true);
+            result[v->id] = ss.candidates.ptr[slots.ptr[s]];
+        }
+
+        free(slots.ptr);
+        free(members);
+        free(interference);
+        free(ss.escaped);
+    }
+
+    free(ss.candidates_by_id);
+    free(ss.pointees_by_id);
+    free(ss.whole_by_id);
+    free(ss.candidates.ptr);
+    return result;
+}
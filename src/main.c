@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,10 +7,12 @@
 #include <llvm-c/Core.h>
 
 
-static const char usage_fmt[] = "Usage: %s [--help] [--verbose] [-O0|-O1|-O2|-O3] FILENAME\n";
+static const char usage_fmt[] = "Usage: %s [--help] [--verbose] [--stats] [--keep-unused] [-O0|-O1|-O2|-O3] FILENAME\n";
 static const char long_help[] =
     "  --help           display this message\n"
     "  --verbose        display a lot of information about all compilation steps\n"
+    "  --stats          display how much work was done to compile each function\n"
+    "  --keep-unused    keep function definitions that main() never calls\n"
     "  -O0/-O1/-O2/-O3  set optimization level (0 = default, 3 = runs fastest)\n"
     ;
 
@@ -26,6 +29,12 @@ void parse_arguments(int argc, char **argv, CommandLineFlags *flags, const char
         } else if (!strcmp(argv[i], "--verbose")) {
             flags->verbose = true;
             i++;
+        } else if (!strcmp(argv[i], "--stats")) {
+            flags->stats = true;
+            i++;
+        } else if (!strcmp(argv[i], "--keep-unused")) {
+            flags->keep_unused_functions = true;
+            i++;
         } else if (strlen(argv[i]) == 3
                 && !strncmp(argv[i], "-O", 2)
                 && argv[i][2] >= '0'
@@ -48,34 +57,84 @@ usage:
     exit(2);
 }
 
+// Typechecks a top-level definition and adds it to the LLVM module.
+static void compile_toplevel_node(
+    AstToplevelNode *topnode, TypeContext *typectx, LLVMModuleRef module, const CommandLineFlags *flags)
+{
+    const Signature *sig;
+    CfGraph *cfg = NULL;
+    FunctionStats stats = {0};
+
+    switch(topnode->kind) {
+    case AST_TOPLEVEL_END_OF_FILE:
+        assert(0);
+    case AST_TOPLEVEL_DEFINE_STRUCT:
+        typecheck_struct(typectx, &topnode->data.structdef, topnode->location);
+        return;
+    case AST_TOPLEVEL_DECLARE_FUNCTION:
+        sig = typecheck_function(typectx, topnode->location, &topnode->data.decl_signature, NULL);
+        break;
+    case AST_TOPLEVEL_DEFINE_FUNCTION:
+        sig = typecheck_function(typectx, topnode->location, &topnode->data.funcdef.signature, &topnode->data.funcdef.body);
+        cfg = build_control_flow_graph(typectx, &topnode->data.funcdef.body);
+        if(flags->verbose)
+            print_function_control_flow_graph(sig, cfg);
+
+        simplify_control_flow_graph(cfg, sig, &stats);
+        if(flags->verbose)
+            print_function_control_flow_graph(sig, cfg);
+        break;
+    }
+
+    codegen_function(module, sig, cfg, &stats);
+    if(flags->stats && cfg)
+        print_function_stats(sig, &stats);
+}
+
 int main(int argc, char **argv)
 {
+    init_names();
     init_types();
 
     CommandLineFlags flags;
     const char *filename;
     parse_arguments(argc, argv, &flags, &filename);
 
-    Token *tokens = tokenize(filename);
-    if(flags.verbose)
-        print_tokens(tokens);
+    if(flags.verbose) {
+        // The parser doesn't need all tokens at once, so they are read separately for printing.
+        Arena token_arena = {0};
+        print_tokens(tokenize(filename, &token_arena));
+        arena_free(&token_arena);
+    }
 
-    AstToplevelNode *ast = parse(tokens);
-    free_tokens(tokens);
-    if(flags.verbose)
-        print_ast(ast);
+    TokenStream *tokenstream = open_token_stream(filename);
+    LLVMModuleRef module = codegen_create_module(filename);
 
-    CfGraphFile cfgfile = build_control_flow_graphs(ast);
-    free_ast(ast);
-    if(flags.verbose)
-        print_control_flow_graphs(&cfgfile);
+    // The AST and control flow graph of each top-level definition are freed
+    // before the next definition is parsed, but the type context keeps the
+    // function signatures and structs that the definitions after it can use.
+    Arena ast_arena = {0}, cfg_arena = {0};
+    TypeContext typectx = { .arena = &cfg_arena };
 
-    simplify_control_flow_graphs(&cfgfile);
-    if(flags.verbose)
-        print_control_flow_graphs(&cfgfile);
+    while(1) {
+        AstToplevelNode topnode = parse_toplevel_node(tokenstream, &ast_arena);
+        if (topnode.kind == AST_TOPLEVEL_END_OF_FILE)
+            break;
+        if(flags.verbose)
+            print_ast(&topnode);
+
+        compile_toplevel_node(&topnode, &typectx, module, &flags);
+        arena_free(&ast_arena);
+        arena_free(&cfg_arena);
+    }
+
+    close_token_stream(tokenstream);
+    destroy_type_context(&typectx);
+
+    // Makes programs with many declarations (such as a big stdlib header) faster to optimize and run.
+    if (!flags.keep_unused_functions)
+        codegen_remove_unused_functions(module);
 
-    LLVMModuleRef module = codegen(&cfgfile);
-    free_control_flow_graphs(&cfgfile);
     if(flags.verbose)
         print_llvm_ir(module);
 
@@ -0,0 +1,204 @@
+// Interned names: each distinct name appears in memory only once.
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jou_compiler.h"
+#include "util.h"
+
+struct InternedName {
+    bool is_keyword;
+    char str[];  // interned names are pointers to this
+};
+
+static struct {
+    bool inited;
+    struct InternedName **slots;  // hash table with open addressing, NULL means empty slot
+    size_t capacity;  // always a power of two
+    size_t count;
+} global_state;
+
+struct KnownNames known_names;
+
+#define KW(s) { &known_names.kw_##s, #s, true }
+static const struct { const char **dest; const char *str; bool is_keyword; } known[] = {
+    KW(def), KW(declare), KW(struct),
+    KW(return), KW(if), KW(elif), KW(else), KW(while), KW(for), KW(break), KW(continue),
+    KW(True), KW(False), KW(NULL),
+    KW(and), KW(or), KW(not), KW(as),
+    KW(void), KW(bool), KW(byte), KW(int),
+    { &known_names.main, "main", false },
+};
+#undef KW
+
+static size_t hash_string(const char *s)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns a pointer to the slot that contains the name, or the empty slot where it should go.
+static struct InternedName **find_slot(struct InternedName **slots, size_t capacity, const char *s)
+{
+    size_t i = hash_string(s) & (capacity - 1);
+    while (slots[i] && strcmp(slots[i]->str, s))
+        i = (i + 1) & (capacity - 1);
+    return &slots[i];
+}
+
+static void grow(void)
+{
+    size_t newcapacity = global_state.capacity ? 2*global_state.capacity : 256;
+    struct InternedName **newslots = calloc(newcapacity, sizeof newslots[0]);
+    if (!newslots) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < global_state.capacity; i++)
+        if (global_state.slots[i])
+            *find_slot(newslots, newcapacity, global_state.slots[i]->str) = global_state.slots[i];
+
+    free(global_state.slots);
+    global_state.slots = newslots;
+    global_state.capacity = newcapacity;
+}
+
+const char *intern_name(const char *s)
+{
+    assert(global_state.inited);
+
+    // Keep the table at most half full, so that probing stays short.
+    if (2*(global_state.count + 1) > global_state.capacity)
+        grow();
+
+    struct InternedName **slot = find_slot(global_state.slots, global_state.capacity, s);
+    if (!*slot) {
+        size_t len = strlen(s);
+        *slot = malloc(sizeof(**slot) + len + 1);
+        if (!*slot) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        (*slot)->is_keyword = false;
+        memcpy((*slot)->str, s, len + 1);
+        global_state.count++;
+    }
+    return (*slot)->str;
+}
+
+bool name_is_keyword(const char *name)
+{
+    const struct InternedName *in = (const struct InternedName *)(name - offsetof(struct InternedName, str));
+    return in->is_keyword;
+}
+
+
+struct NameMapSlot {
+    const char *name;  // NULL means empty slot
+    int value;
+    unsigned generation;
+};
+
+static int namemap_start_index(const NameMap *map, const char *name)
+{
+    // Interned names are unique pointers, so hash the pointer, not the string.
+    uint64_t h = (uint64_t)(uintptr_t)name * 0x9E3779B97F4A7C15u;
+    return (int)(h >> 32) & (map->capacity - 1);
+}
+
+static struct NameMapSlot *namemap_find_slot(const NameMap *map, const char *name)
+{
+    int i = namemap_start_index(map, name);
+    while (map->slots[i].name && map->slots[i].generation == map->generation) {
+        if (map->slots[i].name == name)
+            return &map->slots[i];
+        i = (i + 1) & (map->capacity - 1);
+    }
+    return &map->slots[i];
+}
+
+int namemap_get(const NameMap *map, const char *name)
+{
+    if (map->count == 0)
+        return -1;
+    const struct NameMapSlot *slot = namemap_find_slot(map, name);
+    if (slot->name == name && slot->generation == map->generation)
+        return slot->value;
+    return -1;
+}
+
+void namemap_set(NameMap *map, const char *name, int value)
+{
+    assert(name);
+    assert(value >= 0);
+
+    if (2*(map->count + 1) > map->capacity) {
+        NameMap bigger = { .capacity = map->capacity ? 2*map->capacity : 16 };
+        bigger.slots = calloc(bigger.capacity, sizeof bigger.slots[0]);
+        if (!bigger.slots) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        for (int i = 0; i < map->capacity; i++) {
+            if (map->slots[i].name && map->slots[i].generation == map->generation) {
+                *namemap_find_slot(&bigger, map->slots[i].name) = (struct NameMapSlot){
+                    .name = map->slots[i].name,
+                    .value = map->slots[i].value,
+                };
+                bigger.count++;
+            }
+        }
+        free(map->slots);
+        *map = bigger;
+    }
+
+    struct NameMapSlot *slot = namemap_find_slot(map, name);
+    if (slot->name != name || slot->generation != map->generation)
+        map->count++;
+    *slot = (struct NameMapSlot){ .name = name, .value = value, .generation = map->generation };
+}
+
+void namemap_clear(NameMap *map)
+{
+    map->count = 0;
+    if (++map->generation == 0) {
+        // Wrapped around, old slots could look valid again
+        for (int i = 0; i < map->capacity; i++)
+            map->slots[i].name = NULL;
+    }
+}
+
+void namemap_free(const NameMap *map)
+{
+    free(map->slots);
+}
+
+static void free_global_state(void)
+{
+    assert(global_state.inited);
+    for (size_t i = 0; i < global_state.capacity; i++)
+        free(global_state.slots[i]);
+    free(global_state.slots);
+}
+
+void init_names(void)
+{
+    assert(!global_state.inited);
+    global_state.inited = true;
+
+    for (size_t i = 0; i < sizeof(known)/sizeof(known[0]); i++) {
+        const char *name = intern_name(known[i].str);
+        ((struct InternedName *)(name - offsetof(struct InternedName, str)))->is_keyword = known[i].is_keyword;
+        *known[i].dest = name;
+    }
+
+    atexit(free_global_state);  // not really necessary, but makes valgrind happier
+}
@@ -7,6 +7,11 @@
 #include <stdio.h>
 #include <string.h>
 
+struct State {
+    const Token *tokens;
+    Arena *arena;  // AST nodes go here
+};
+
 static noreturn void fail_with_parse_error(const Token *token, const char *what_was_expected_instead)
 {
     char got[200];
@@ -27,7 +32,7 @@ static noreturn void fail_with_parse_error(const Token *token, const char *what_
 
 static bool is_keyword(const Token *t, const char *kw)
 {
-    return t->type == TOKEN_KEYWORD && !strcmp(t->data.name, kw);
+    return t->type == TOKEN_KEYWORD && t->data.name == kw;
 }
 
 static bool is_operator(const Token *t, const char *op)
@@ -35,244 +40,244 @@ static bool is_operator(const Token *t, const char *op)
     return t->type == TOKEN_OPERATOR && !strcmp(t->data.operator, op);
 }
 
-static AstType parse_type(const Token **tokens)
+static AstType parse_type(struct State *st)
 {
-    struct AstType result = { .location = (*tokens)->location };
+    struct AstType result = { .location = st->tokens->location };
 
-    if (!is_keyword(*tokens, "void")
-        && !is_keyword(*tokens, "int")
-        && !is_keyword(*tokens, "byte")
-        && !is_keyword(*tokens, "bool")
-        && (*tokens)->type != TOKEN_NAME)
+    if (!is_keyword(st->tokens, known_names.kw_void)
+        && !is_keyword(st->tokens, known_names.kw_int)
+        && !is_keyword(st->tokens, known_names.kw_byte)
+        && !is_keyword(st->tokens, known_names.kw_bool)
+        && st->tokens->type != TOKEN_NAME)
     {
-        fail_with_parse_error(*tokens, "a type");
+        fail_with_parse_error(st->tokens, "a type");
     }
-    safe_strcpy(result.name, (*tokens)->data.name);
-    ++*tokens;
+    result.name = st->tokens->data.name;
+    ++st->tokens;
 
-    while (is_operator(*tokens, "*")) {
+    while (is_operator(st->tokens, "*")) {
         result.npointers++;
-        ++*tokens;
+        ++st->tokens;
     }
 
     return result;
 }
 
-// char[100] is wrapped in a struct so that you can do List(Name).
-// You can't do List(char[100]) or similar because C doesn't allow assigning arrays.
-struct Name { char name[100]; };
-static_assert(sizeof(struct Name) == 100, "u have weird c compiler...");
-typedef List(struct Name) NameList;
+typedef List(const char *) NameList;
 typedef List(AstType) TypeList;
 
 static void parse_name_and_type(
-    const Token **tokens, NameList *names, TypeList *types,
+    struct State *st, NameList *names, TypeList *types,
     const char *expected_what_for_name, // e.g. "an argument name" to get error message "expected an argument name, got blah"
     const char *duplicate_name_error_fmt)  // %s will be replaced by a name
 {
-    if((*tokens)->type != TOKEN_NAME)
-        fail_with_parse_error(*tokens, expected_what_for_name);
+    if(st->tokens->type != TOKEN_NAME)
+        fail_with_parse_error(st->tokens, expected_what_for_name);
 
     for (int i = 0; i < names->len; i++) {
-        if (!strcmp(names->ptr[i].name, (*tokens)->data.name)) {
-            fail_with_error((*tokens)->location, duplicate_name_error_fmt, (*tokens)->data.name);
+        if (names->ptr[i] == st->tokens->data.name) {
+            fail_with_error(st->tokens->location, duplicate_name_error_fmt, st->tokens->data.name);
         }
     }
 
-    struct Name n;
-    safe_strcpy(n.name, (*tokens)->data.name);
-    Append(names, n);
-    ++*tokens;
+    ArenaAppend(st->arena, names, st->tokens->data.name);
+    ++st->tokens;
 
-    if (!is_operator(*tokens, ":"))
-        fail_with_parse_error(*tokens, "':' and a type after it (example: \"foo: int\")");
-    ++*tokens;
-    Append(types, parse_type(tokens));
+    if (!is_operator(st->tokens, ":"))
+        fail_with_parse_error(st->tokens, "':' and a type after it (example: \"foo: int\")");
+    ++st->tokens;
+    ArenaAppend(st->arena, types, parse_type(st));
 }
 
-static AstSignature parse_function_signature(const Token **tokens)
+static AstSignature parse_function_signature(struct State *st)
 {
     AstSignature result = {0};
 
-    if ((*tokens)->type != TOKEN_NAME)
-        fail_with_parse_error(*tokens, "a function name");
-    safe_strcpy(result.funcname, (*tokens)->data.name);
-    ++*tokens;
+    if (st->tokens->type != TOKEN_NAME)
+        fail_with_parse_error(st->tokens, "a function name");
+    result.funcname = st->tokens->data.name;
+    ++st->tokens;
 
-    if (!is_operator(*tokens, "("))
-        fail_with_parse_error(*tokens, "a '(' to denote the start of function arguments");
-    ++*tokens;
+    if (!is_operator(st->tokens, "("))
+        fail_with_parse_error(st->tokens, "a '(' to denote the start of function arguments");
+    ++st->tokens;
 
     NameList argnames = {0};
     TypeList argtypes = {0};
 
-    while (!is_operator(*tokens, ")")) {
+    while (!is_operator(st->tokens, ")")) {
         if (result.takes_varargs)
-            fail_with_error((*tokens)->location, "if '...' is used, it must be the last parameter");
+            fail_with_error(st->tokens->location, "if '...' is used, it must be the last parameter");
 
-        if (is_operator(*tokens, "...")) {
+        if (is_operator(st->tokens, "...")) {
             result.takes_varargs = true;
-            ++*tokens;
+            ++st->tokens;
         } else {
             parse_name_and_type(
-                tokens, &argnames, &argtypes,
+                st, &argnames, &argtypes,
                 "an argument name", "there are multiple arguments named '%s'");
         }
 
-        if (is_operator(*tokens, ","))
-            ++*tokens;
+        if (is_operator(st->tokens, ","))
+            ++st->tokens;
         else
             break;
     }
 
-    if (!is_operator(*tokens, ")"))
-        fail_with_parse_error(*tokens, "a ')'");
-    ++*tokens;
+    if (!is_operator(st->tokens, ")"))
+        fail_with_parse_error(st->tokens, "a ')'");
+    ++st->tokens;
 
-    result.argnames = (char(*)[100])argnames.ptr;  // sometimes c syntax surprises me
+    result.argnames = argnames.ptr;
     result.argtypes = argtypes.ptr;
     assert(argnames.len == argtypes.len);
     result.nargs = argnames.len;
 
-    if (!is_operator(*tokens, "->")) {
+    if (!is_operator(st->tokens, "->")) {
         // Special case for common typo:   def foo():
-        if (is_operator(*tokens, ":")) {
+        if (is_operator(st->tokens, ":")) {
             fail_with_error(
-                (*tokens)->location,
+                st->tokens->location,
                 "return type must be specified with '->',"
                 " or with '-> void' if the function doesn't return anything"
             );
         }
-        fail_with_parse_error(*tokens, "a '->'");
+        fail_with_parse_error(st->tokens, "a '->'");
     }
-    ++*tokens;
+    ++st->tokens;
 
-    result.returntype = parse_type(tokens);
+    result.returntype = parse_type(st);
     return result;
 }
 
-static AstExpression parse_expression(const Token **tokens);
+static AstExpression *parse_expression(struct State *st);
+
+static AstExpression *new_expression(struct State *st, Location location, enum AstExpressionKind kind)
+{
+    AstExpression *expr = arena_alloc(st->arena, sizeof *expr);
+    expr->location = location;
+    expr->kind = kind;
+    return expr;
+}
 
-static AstCall parse_call(const Token **tokens, char openparen, char closeparen, bool args_are_named)
+static AstCall parse_call(struct State *st, char openparen, char closeparen, bool args_are_named)
 {
     AstCall result = {0};
 
-    assert((*tokens)->type == TOKEN_NAME);  // must be checked when calling this function
-    safe_strcpy(result.calledname, (*tokens)->data.name);
-    ++*tokens;
+    assert(st->tokens->type == TOKEN_NAME);  // must be checked when calling this function
+    result.calledname = st->tokens->data.name;
+    ++st->tokens;
 
-    if (!is_operator(*tokens, (char[]){openparen,'\0'})) {
+    if (!is_operator(st->tokens, (char[]){openparen,'\0'})) {
         char msg[100];
         sprintf(msg, "a '%c' to denote the start of arguments", openparen);
-        fail_with_parse_error(*tokens, msg);
+        fail_with_parse_error(st->tokens, msg);
     }
-    ++*tokens;
+    ++st->tokens;
 
-    List(AstExpression) args = {0};
-    List(struct Name) argnames = {0};
+    List(AstExpression *) args = {0};
+    NameList argnames = {0};
 
-    while (!is_operator(*tokens, (char[]){closeparen,'\0'})) {
+    while (!is_operator(st->tokens, (char[]){closeparen,'\0'})) {
         if (args_are_named) {
             // This code is only for structs, because there are no named function arguments.
 
-            if ((*tokens)->type != TOKEN_NAME)
-                fail_with_parse_error((*tokens),"a field name");
+            if (st->tokens->type != TOKEN_NAME)
+                fail_with_parse_error(st->tokens,"a field name");
 
-            for (struct Name *oldname = argnames.ptr; oldname < End(argnames); oldname++) {
-                if (!strcmp(oldname->name, (*tokens)->data.name)) {
+            const char *name = st->tokens->data.name;
+            for (const char **oldname = argnames.ptr; oldname < End(argnames); oldname++) {
+                if (*oldname == name) {
                     fail_with_error(
-                        (*tokens)->location, "there are two arguments named '%s'", oldname->name);
+                        st->tokens->location, "there are two arguments named '%s'", name);
                 }
             }
 
-            struct Name n;
-            safe_strcpy(n.name,(*tokens)->data.name);
-            Append(&argnames,n);
-            ++*tokens;
+            ArenaAppend(st->arena, &argnames, name);
+            ++st->tokens;
 
-            if (!is_operator(*tokens, "=")) {
+            if (!is_operator(st->tokens, "=")) {
                 char msg[300];
-                snprintf(msg, sizeof msg, "'=' followed by a value for field '%s'", n.name);
-                fail_with_parse_error(*tokens, msg);
+                snprintf(msg, sizeof msg, "'=' followed by a value for field '%s'", name);
+                fail_with_parse_error(st->tokens, msg);
             }
-            ++*tokens;
+            ++st->tokens;
         }
 
-        Append(&args, parse_expression(tokens));
-        if (is_operator(*tokens, ","))
-            ++*tokens;
+        AstExpression *arg = parse_expression(st);
+        ArenaAppend(st->arena, &args, arg);
+        if (is_operator(st->tokens, ","))
+            ++st->tokens;
         else
             break;
     }
 
     result.args = args.ptr;
-    result.argnames = (char(*)[100])argnames.ptr;  // can be NULL
+    result.argnames = argnames.ptr;  // can be NULL
     result.nargs = args.len;
 
-    if (!is_operator(*tokens, (char[]){closeparen,'\0'})) {
+    if (!is_operator(st->tokens, (char[]){closeparen,'\0'})) {
         char msg[100];
         sprintf(msg, "a '%c'", closeparen);
-        fail_with_parse_error(*tokens, "a ')'");
+        fail_with_parse_error(st->tokens, "a ')'");
     }
-    ++*tokens;
+    ++st->tokens;
 
     return result;
 }
 
-// arity = number of operands, e.g. 2 for a binary operator such as "+"
-static AstExpression build_operator_expression(const Token *t, int arity, const AstExpression *operands)
+// rhs is NULL for unary operators
+static AstExpression *build_operator_expression(struct State *st, const Token *t, AstExpression *lhs, AstExpression *rhs)
 {
-    assert(arity==1 || arity==2);
-    size_t nbytes = arity * sizeof operands[0];
-    AstExpression *ptr = malloc(nbytes);
-    memcpy(ptr, operands, nbytes);
-
-    AstExpression result = { .location = t->location, .data.operands = ptr };
+    int arity = rhs ? 2 : 1;
+    AstExpression *result = new_expression(st, t->location, 0);
+    result->data.operands[0] = lhs;
+    result->data.operands[1] = rhs;
 
     if (is_operator(t, "&")) {
         assert(arity == 1);
-        result.kind = AST_EXPR_ADDRESS_OF;
+        result->kind = AST_EXPR_ADDRESS_OF;
     } else if (is_operator(t, "[")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_INDEXING;
+        result->kind = AST_EXPR_INDEXING;
     } else if (is_operator(t, "==")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_EQ;
+        result->kind = AST_EXPR_EQ;
     } else if (is_operator(t, "!=")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_NE;
+        result->kind = AST_EXPR_NE;
     } else if (is_operator(t, ">")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_GT;
+        result->kind = AST_EXPR_GT;
     } else if (is_operator(t, ">=")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_GE;
+        result->kind = AST_EXPR_GE;
     } else if (is_operator(t, "<")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_LT;
+        result->kind = AST_EXPR_LT;
     } else if (is_operator(t, "<=")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_LE;
+        result->kind = AST_EXPR_LE;
     } else if (is_operator(t, "+")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_ADD;
+        result->kind = AST_EXPR_ADD;
     } else if (is_operator(t, "-")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_SUB;
+        result->kind = AST_EXPR_SUB;
     } else if (is_operator(t, "*")) {
-        result.kind = arity==2 ? AST_EXPR_MUL : AST_EXPR_DEREFERENCE;
+        result->kind = arity==2 ? AST_EXPR_MUL : AST_EXPR_DEREFERENCE;
     } else if (is_operator(t, "/")) {
         assert(arity == 2);
-        result.kind = AST_EXPR_DIV;
-    } else if (is_keyword(t, "and")) {
+        result->kind = AST_EXPR_DIV;
+    } else if (is_keyword(t, known_names.kw_and)) {
         assert(arity == 2);
-        result.kind = AST_EXPR_AND;
-    } else if (is_keyword(t, "or")) {
+        result->kind = AST_EXPR_AND;
+    } else if (is_keyword(t, known_names.kw_or)) {
         assert(arity == 2);
-        result.kind = AST_EXPR_OR;
-    } else if (is_keyword(t, "not")) {
+        result->kind = AST_EXPR_OR;
+    } else if (is_keyword(t, known_names.kw_not)) {
         assert(arity == 1);
-        result.kind = AST_EXPR_NOT;
+        result->kind = AST_EXPR_NOT;
     } else {
         assert(0);
     }
@@ -280,74 +285,74 @@ static AstExpression build_operator_expression(const Token *t, int arity, const
     return result;
 }
 
-// If tokens is e.g. [1, '+', 2], this will be used to parse the ['+', 2] part.
+// If tokens are e.g. [1, '+', 2], this will be used to parse the ['+', 2] part.
 // Callback function cb defines how to parse the expression following the operator token.
-static void add_to_binop(const Token **tokens, AstExpression *result, AstExpression (*cb)(const Token**))
+static void add_to_binop(struct State *st, AstExpression **result, AstExpression *(*cb)(struct State *))
 {
-    const Token *t = (*tokens)++;
-    AstExpression rhs = cb(tokens);
-    *result = build_operator_expression(t, 2, (AstExpression[]){*result, rhs});
+    const Token *t = st->tokens++;
+    AstExpression *rhs = cb(st);
+    *result = build_operator_expression(st, t, *result, rhs);
 }
 
-static AstExpression parse_elementary_expression(const Token **tokens)
+static AstExpression *parse_elementary_expression(struct State *st)
 {
-    AstExpression expr = { .location = (*tokens)->location };
+    AstExpression *expr;
 
-    switch((*tokens)->type) {
+    switch(st->tokens->type) {
     case TOKEN_OPERATOR:
-        if (!is_operator(*tokens, "("))
+        if (!is_operator(st->tokens, "("))
             goto not_an_expression;
-        ++*tokens;
-        expr = parse_expression(tokens);
-        if (!is_operator(*tokens, ")"))
-            fail_with_parse_error(*tokens, "a ')'");
-        ++*tokens;
+        ++st->tokens;
+        expr = parse_expression(st);
+        if (!is_operator(st->tokens, ")"))
+            fail_with_parse_error(st->tokens, "a ')'");
+        ++st->tokens;
         break;
     case TOKEN_INT:
-        expr.kind = AST_EXPR_CONSTANT;
-        expr.data.constant = (Constant){ CONSTANT_INTEGER, {.integer={
+        expr = new_expression(st, st->tokens->location, AST_EXPR_CONSTANT);
+        expr->data.constant = (Constant){ CONSTANT_INTEGER, {.integer={
             .is_signed = true,
-            .value = (*tokens)->data.int_value,
+            .value = st->tokens->data.int_value,
             .width_in_bits = 32,
         }}};
-        ++*tokens;
+        ++st->tokens;
         break;
     case TOKEN_CHAR:
-        expr.kind = AST_EXPR_CONSTANT;
-        expr.data.constant = (Constant){ CONSTANT_INTEGER, {.integer={
+        expr = new_expression(st, st->tokens->location, AST_EXPR_CONSTANT);
+        expr->data.constant = (Constant){ CONSTANT_INTEGER, {.integer={
             .is_signed = false,
-            .value = (*tokens)->data.char_value,
+            .value = st->tokens->data.char_value,
             .width_in_bits = 8,
         }}};
-        ++*tokens;
+        ++st->tokens;
         break;
     case TOKEN_STRING:
-        expr.kind = AST_EXPR_CONSTANT;
-        expr.data.constant = (Constant){ CONSTANT_STRING, {.str=strdup((*tokens)->data.string_value)} };
-        ++*tokens;
+        expr = new_expression(st, st->tokens->location, AST_EXPR_CONSTANT);
+        expr->data.constant = (Constant){ CONSTANT_STRING, {.str=arena_strdup(st->arena, st->tokens->data.string_value)} };
+        ++st->tokens;
         break;
     case TOKEN_NAME:
-        if (is_operator(&(*tokens)[1], "(")) {
-            expr.kind = AST_EXPR_FUNCTION_CALL;
-            expr.data.call = parse_call(tokens, '(', ')', false);
-        } else if (is_operator(&(*tokens)[1], "{")) {
-            expr.kind = AST_EXPR_BRACE_INIT;
-            expr.data.call = parse_call(tokens, '{', '}', true);
+        if (is_operator(&st->tokens[1], "(")) {
+            expr = new_expression(st, st->tokens->location, AST_EXPR_FUNCTION_CALL);
+            expr->data.call = parse_call(st, '(', ')', false);
+        } else if (is_operator(&st->tokens[1], "{")) {
+            expr = new_expression(st, st->tokens->location, AST_EXPR_BRACE_INIT);
+            expr->data.call = parse_call(st, '{', '}', true);
         } else {
-            expr.kind = AST_EXPR_GET_VARIABLE;
-            safe_strcpy(expr.data.varname, (*tokens)->data.name);
-            ++*tokens;
+            expr = new_expression(st, st->tokens->location, AST_EXPR_GET_VARIABLE);
+            expr->data.varname = st->tokens->data.name;
+            ++st->tokens;
         }
         break;
     case TOKEN_KEYWORD:
-        if (is_keyword(*tokens, "True") || is_keyword(*tokens, "False")) {
-            expr.kind = AST_EXPR_CONSTANT;
-            expr.data.constant = (Constant){ CONSTANT_BOOL, {.boolean=is_keyword(*tokens, "True")} };
-            ++*tokens;
-        } else if (is_keyword(*tokens, "NULL")) {
-            expr.kind = AST_EXPR_CONSTANT;
-            expr.data.constant = (Constant){ CONSTANT_NULL, {{0}} };
-            ++*tokens;
+        if (is_keyword(st->tokens, known_names.kw_True) || is_keyword(st->tokens, known_names.kw_False)) {
+            expr = new_expression(st, st->tokens->location, AST_EXPR_CONSTANT);
+            expr->data.constant = (Constant){ CONSTANT_BOOL, {.boolean=is_keyword(st->tokens, known_names.kw_True)} };
+            ++st->tokens;
+        } else if (is_keyword(st->tokens, known_names.kw_NULL)) {
+            expr = new_expression(st, st->tokens->location, AST_EXPR_CONSTANT);
+            expr->data.constant = (Constant){ CONSTANT_NULL, {{0}} };
+            ++st->tokens;
         } else {
             goto not_an_expression;
         }
@@ -358,52 +363,49 @@ static AstExpression parse_elementary_expression(const Token **tokens)
     return expr;
 
 not_an_expression:
-    fail_with_parse_error(*tokens, "an expression");
+    fail_with_parse_error(st->tokens, "an expression");
 }
 
-static AstExpression parse_expression_with_fields_and_indexing(const Token **tokens)
+static AstExpression *parse_expression_with_fields_and_indexing(struct State *st)
 {
-    AstExpression result = parse_elementary_expression(tokens);
-    while (is_operator(*tokens, ".") || is_operator(*tokens, "->") || is_operator(*tokens, "["))
+    AstExpression *result = parse_elementary_expression(st);
+    while (is_operator(st->tokens, ".") || is_operator(st->tokens, "->") || is_operator(st->tokens, "["))
     {
-        if (is_operator(*tokens, "[")) {
-            add_to_binop(tokens, &result, parse_expression);  // eats [ token
-            if (!is_operator(*tokens, "]"))
-                fail_with_parse_error(*tokens, "a ']'");
-            ++*tokens;
+        if (is_operator(st->tokens, "[")) {
+            add_to_binop(st, &result, parse_expression);  // eats [ token
+            if (!is_operator(st->tokens, "]"))
+                fail_with_parse_error(st->tokens, "a ']'");
+            ++st->tokens;
         } else {
-            const Token *startop = (*tokens)++;
-            AstExpression result2 = {
-                .location = startop->location,
-                .kind = (is_operator(startop, "->") ? AST_EXPR_DEREF_AND_GET_FIELD : AST_EXPR_GET_FIELD),
-            };
-            result2.data.field.obj = malloc(sizeof *result2.data.field.obj);
-            *result2.data.field.obj = result;
-
-            if ((*tokens)->type != TOKEN_NAME)
-                fail_with_parse_error(*tokens, "a field name");
-            safe_strcpy(result2.data.field.fieldname, (*tokens)->data.name);
-            ++*tokens;
-
-            result = result2;
+            const Token *startop = st->tokens++;
+            AstExpression *obj = result;
+            result = new_expression(
+                st, startop->location,
+                is_operator(startop, "->") ? AST_EXPR_DEREF_AND_GET_FIELD : AST_EXPR_GET_FIELD);
+            result->data.field.obj = obj;
+
+            if (st->tokens->type != TOKEN_NAME)
+                fail_with_parse_error(st->tokens, "a field name");
+            result->data.field.fieldname = st->tokens->data.name;
+            ++st->tokens;
         }
     }
     return result;
 }
 
 // Unary operators: foo++, foo--, ++foo, --foo, &foo, *foo
-static AstExpression parse_expression_with_unary_operators(const Token **tokens)
+static AstExpression *parse_expression_with_unary_operators(struct State *st)
 {
     // sequneces of 0 or more unary operator tokens: start,start+1,...,end-1
-    const Token *prefixstart = *tokens;
-    while(is_operator(*tokens,"++")||is_operator(*tokens,"--")||is_operator(*tokens,"&")||is_operator(*tokens,"*")) ++*tokens;
-    const Token *prefixend = *tokens;
+    const Token *prefixstart = st->tokens;
+    while(is_operator(st->tokens,"++")||is_operator(st->tokens,"--")||is_operator(st->tokens,"&")||is_operator(st->tokens,"*")) ++st->tokens;
+    const Token *prefixend = st->tokens;
 
-    AstExpression result = parse_expression_with_fields_and_indexing(tokens);
+    AstExpression *result = parse_expression_with_fields_and_indexing(st);
 
-    const Token *suffixstart = *tokens;
-    while(is_operator(*tokens,"++")||is_operator(*tokens,"--")) ++*tokens;
-    const Token *suffixend = *tokens;
+    const Token *suffixstart = st->tokens;
+    while(is_operator(st->tokens,"++")||is_operator(st->tokens,"--")) ++st->tokens;
+    const Token *suffixend = st->tokens;
 
     while (prefixstart<prefixend || suffixstart<suffixend) {
         // ++ and -- "bind tighter", so *foo++ is equivalent to *(foo++)
@@ -433,99 +435,132 @@ static AstExpression parse_expression_with_unary_operators(const Token **tokens)
             loc = (--prefixend)->location;
         }
 
-        AstExpression *p = malloc(sizeof(*p));
-        *p = result;
-        result = (AstExpression){ .location=loc, .kind=k, .data.operands=p };
+        AstExpression *operand = result;
+        result = new_expression(st, loc, k);
+        result->data.operands[0] = operand;
     }
 
     return result;
 }
 
-static AstExpression parse_expression_with_mul_and_div(const Token **tokens)
-{
-    AstExpression result = parse_expression_with_unary_operators(tokens);
-    while (is_operator(*tokens, "*") || is_operator(*tokens, "/"))
-        add_to_binop(tokens, &result, parse_expression_with_unary_operators);
-    return result;
-}
-
-static AstExpression parse_expression_with_add(const Token **tokens)
+/*
+Binary operators, "as" and "not" are parsed with precedence climbing (a Pratt
+parser). Everything that binds tighter than "*" and "/" is an operand, parsed
+by parse_expression_with_unary_operators().
+
+Precedences are listed from loosest to tightest. An operator only applies to
+expressions whose precedence is at least as tight as its own, so that e.g.
+"x as int + 1" is an error like it used to be, instead of "(x as int) + 1".
+*/
+enum Precedence {
+    PREC_NONE,
+    PREC_AND_OR,  // 'and' and 'or' can't be mixed without parentheses
+    PREC_NOT,
+    PREC_COMPARE,  // comparisons can't be chained: "a < b < c" is an error
+    PREC_AS,  // "as" has somewhat low precedence, so that "1+2 as float" works as expected
+    PREC_ADD,
+    PREC_MUL,
+    PREC_OPERAND,
+};
+
+static const struct { enum TokenType toktype; const char *text; enum Precedence prec; } infix_operators[] = {
+    { TOKEN_KEYWORD, "and", PREC_AND_OR },
+    { TOKEN_KEYWORD, "or", PREC_AND_OR },
+    { TOKEN_OPERATOR, "==", PREC_COMPARE },
+    { TOKEN_OPERATOR, "!=", PREC_COMPARE },
+    { TOKEN_OPERATOR, "<", PREC_COMPARE },
+    { TOKEN_OPERATOR, ">", PREC_COMPARE },
+    { TOKEN_OPERATOR, "<=", PREC_COMPARE },
+    { TOKEN_OPERATOR, ">=", PREC_COMPARE },
+    { TOKEN_KEYWORD, "as", PREC_AS },
+    { TOKEN_OPERATOR, "+", PREC_ADD },
+    { TOKEN_OPERATOR, "-", PREC_ADD },
+    { TOKEN_OPERATOR, "*", PREC_MUL },
+    { TOKEN_OPERATOR, "/", PREC_MUL },
+};
+
+// Returns PREC_NONE if the token is not an infix operator.
+static enum Precedence get_infix_precedence(const Token *t)
 {
-    AstExpression result = parse_expression_with_mul_and_div(tokens);
-    while (is_operator(*tokens, "+") || is_operator(*tokens, "-"))
-        add_to_binop(tokens, &result, parse_expression_with_mul_and_div);
-    return result;
-}
-
-// "as" operator has somewhat low precedence, so that "1+2 as float" works as expected
-static AstExpression parse_expression_with_as(const Token **tokens)
-{
-    AstExpression result = parse_expression_with_add(tokens);
-    while (is_keyword(*tokens, "as")) {
-        AstExpression *p = malloc(sizeof(*p));
-        *p = result;
-        Location as_location = (*tokens)++->location;
-        AstType t = parse_type(tokens);
-        result = (AstExpression){ .location=as_location, .kind=AST_EXPR_AS, .data.as = { .obj=p, .type=t } };
-    }
-    return result;
-}
-
-static AstExpression parse_expression_with_comparisons(const Token **tokens)
-{
-    AstExpression result = parse_expression_with_as(tokens);
-#define IsComparator(x) (is_operator((x),"<") || is_operator((x),">") || is_operator((x),"<=") || is_operator((x),">=") || is_operator((x),"==") || is_operator((x),"!="))
-    if (IsComparator(*tokens))
-        add_to_binop(tokens, &result, parse_expression_with_as);
-    if (IsComparator(*tokens))
-        fail_with_error((*tokens)->location, "comparisons cannot be chained");
-#undef IsComparator
-    return result;
+    const char *text;
+    if (t->type == TOKEN_OPERATOR)
+        text = t->data.operator;
+    else if (t->type == TOKEN_KEYWORD)
+        text = t->data.name;
+    else
+        return PREC_NONE;
+
+    for (int i = 0; i < (int)(sizeof(infix_operators)/sizeof(infix_operators[0])); i++)
+        if (infix_operators[i].toktype == t->type && !strcmp(infix_operators[i].text, text))
+            return infix_operators[i].prec;
+    return PREC_NONE;
 }
 
-static AstExpression parse_expression_with_not(const Token **tokens)
+// Parses an expression consisting of operators whose precedence is minprec or tighter.
+static AstExpression *parse_expression_with_precedence(struct State *st, enum Precedence minprec)
 {
-    const Token *nottoken = NULL;
-    if (is_keyword(*tokens, "not")) {
-        nottoken = *tokens;
-        ++*tokens;
+    AstExpression *result;
+    enum Precedence resultprec;  // how tightly the operators already in result bind
+
+    if (minprec <= PREC_NOT && is_keyword(st->tokens, known_names.kw_not)) {
+        const Token *nottoken = st->tokens++;
+        if (is_keyword(st->tokens, known_names.kw_not))
+            fail_with_error(st->tokens->location, "'not' cannot be repeated");
+        AstExpression *operand = parse_expression_with_precedence(st, PREC_COMPARE);
+        result = build_operator_expression(st, nottoken, operand, NULL);
+        resultprec = PREC_NOT;
+    } else {
+        result = parse_expression_with_unary_operators(st);
+        resultprec = PREC_OPERAND;
     }
-    if (is_keyword(*tokens, "not"))
-        fail_with_error((*tokens)->location, "'not' cannot be repeated");
-
-    AstExpression result = parse_expression_with_comparisons(tokens);
-    if (nottoken)
-        result = build_operator_expression(nottoken, 1, &result);
-    return result;
-}
 
-static AstExpression parse_expression_with_and_or(const Token **tokens)
-{
-    AstExpression result = parse_expression_with_not(tokens);
     bool got_and = false, got_or = false;
-
-    while (is_keyword(*tokens, "and") || is_keyword(*tokens, "or")) {
-        got_and = got_and || is_keyword(*tokens, "and");
-        got_or = got_or || is_keyword(*tokens, "or");
-        if (got_and && got_or)
-            fail_with_error((*tokens)->location, "'and' cannot be chained with 'or', you need more parentheses");
-
-        add_to_binop(tokens, &result, parse_expression_with_not);
+    enum Precedence prec;
+    while ((prec = get_infix_precedence(st->tokens)) >= minprec && prec <= resultprec) {
+        const Token *optoken = st->tokens++;
+
+        switch(prec) {
+        case PREC_AND_OR:
+            got_and = got_and || is_keyword(optoken, known_names.kw_and);
+            got_or = got_or || is_keyword(optoken, known_names.kw_or);
+            if (got_and && got_or)
+                fail_with_error(optoken->location, "'and' cannot be chained with 'or', you need more parentheses");
+            result = build_operator_expression(st, optoken, result, parse_expression_with_precedence(st, PREC_NOT));
+            break;
+        case PREC_COMPARE:
+            result = build_operator_expression(st, optoken, result, parse_expression_with_precedence(st, PREC_AS));
+            if (get_infix_precedence(st->tokens) == PREC_COMPARE)
+                fail_with_error(st->tokens->location, "comparisons cannot be chained");
+            break;
+        case PREC_AS:
+        {
+            AstExpression *obj = result;
+            result = new_expression(st, optoken->location, AST_EXPR_AS);
+            result->data.as.obj = obj;
+            result->data.as.type = parse_type(st);
+            break;
+        }
+        default:
+            // left-associative: 1-2-3 is (1-2)-3
+            result = build_operator_expression(st, optoken, result, parse_expression_with_precedence(st, prec+1));
+            break;
+        }
+        resultprec = prec;
     }
 
     return result;
 }
 
-static AstExpression parse_expression(const Token **tokens)
+static AstExpression *parse_expression(struct State *st)
 {
-    return parse_expression_with_and_or(tokens);
+    return parse_expression_with_precedence(st, PREC_AND_OR);
 }
 
-static void eat_newline(const Token **tokens)
+static void eat_newline(struct State *st)
 {
-    if ((*tokens)->type != TOKEN_NEWLINE)
-        fail_with_parse_error(*tokens, "end of line");
-    ++*tokens;
+    if (st->tokens->type != TOKEN_NEWLINE)
+        fail_with_parse_error(st->tokens, "end of line");
+    ++st->tokens;
 }
 
 static void validate_expression_statement(const AstExpression *expr)
@@ -543,24 +578,33 @@ static void validate_expression_statement(const AstExpression *expr)
     }
 }
 
-static AstBody parse_body(const Token **tokens);
+// The statement starts at the current token.
+static AstStatement *new_statement(struct State *st, enum AstStatementKind kind)
+{
+    AstStatement *stmt = arena_alloc(st->arena, sizeof *stmt);
+    stmt->location = st->tokens->location;
+    stmt->kind = kind;
+    return stmt;
+}
+
+static AstBody parse_body(struct State *st);
 
-static AstIfStatement parse_if_statement(const Token **tokens)
+static AstIfStatement parse_if_statement(struct State *st)
 {
     List(AstConditionAndBody) if_elifs = {0};
 
-    assert(is_keyword(*tokens, "if"));
+    assert(is_keyword(st->tokens, known_names.kw_if));
     do {
-        ++*tokens;
-        AstExpression cond = parse_expression(tokens);
-        AstBody body = parse_body(tokens);
-        Append(&if_elifs, (AstConditionAndBody){cond,body});
-    } while (is_keyword(*tokens, "elif"));
+        ++st->tokens;
+        AstExpression *cond = parse_expression(st);
+        AstBody body = parse_body(st);
+        ArenaAppend(st->arena, &if_elifs, (AstConditionAndBody){cond,body});
+    } while (is_keyword(st->tokens, known_names.kw_elif));
 
     AstBody elsebody = {0};
-    if (is_keyword(*tokens, "else")) {
-        ++*tokens;
-        elsebody = parse_body(tokens);
+    if (is_keyword(st->tokens, known_names.kw_else)) {
+        ++st->tokens;
+        elsebody = parse_body(st);
     }
 
     return (AstIfStatement){
@@ -571,191 +615,187 @@ static AstIfStatement parse_if_statement(const Token **tokens)
 }
 
 // does not eat a trailing newline
-static AstStatement parse_oneline_statement(const Token **tokens)
+static AstStatement *parse_oneline_statement(struct State *st)
 {
-    AstStatement result = { .location = (*tokens)->location };
-    if (is_keyword(*tokens, "return")) {
-        ++*tokens;
-        if ((*tokens)->type == TOKEN_NEWLINE) {
-            result.kind = AST_STMT_RETURN_WITHOUT_VALUE;
-        } else {
-            result.kind = AST_STMT_RETURN_VALUE;
-            result.data.expression = parse_expression(tokens);
+    AstStatement *result;
+    if (is_keyword(st->tokens, known_names.kw_return)) {
+        result = new_statement(st, AST_STMT_RETURN_WITHOUT_VALUE);
+        ++st->tokens;
+        if (st->tokens->type != TOKEN_NEWLINE) {
+            result->kind = AST_STMT_RETURN_VALUE;
+            result->data.expression = parse_expression(st);
         }
-    } else if (is_keyword(*tokens, "break")) {
-        ++*tokens;
-        result.kind = AST_STMT_BREAK;
-    } else if (is_keyword(*tokens, "continue")) {
-        ++*tokens;
-        result.kind = AST_STMT_CONTINUE;
-    } else if ((*tokens)->type == TOKEN_NAME && is_operator(&(*tokens)[1], ":")) {
+    } else if (is_keyword(st->tokens, known_names.kw_break)) {
+        result = new_statement(st, AST_STMT_BREAK);
+        ++st->tokens;
+    } else if (is_keyword(st->tokens, known_names.kw_continue)) {
+        result = new_statement(st, AST_STMT_CONTINUE);
+        ++st->tokens;
+    } else if (st->tokens->type == TOKEN_NAME && is_operator(&st->tokens[1], ":")) {
         // "foo: int" creates a variable "foo" of type "int"
-        result.kind = AST_STMT_DECLARE_LOCAL_VAR;
-        safe_strcpy(result.data.vardecl.name, (*tokens)->data.name);
-        *tokens += 2;
-        result.data.vardecl.type = parse_type(tokens);
-        if (is_operator(*tokens, "=")) {
-            ++*tokens;
-            AstExpression *p = malloc(sizeof *p);
-            *p = parse_expression(tokens);
-            result.data.vardecl.initial_value = p;
+        result = new_statement(st, AST_STMT_DECLARE_LOCAL_VAR);
+        result->data.vardecl.name = st->tokens->data.name;
+        st->tokens += 2;
+        result->data.vardecl.type = parse_type(st);
+        if (is_operator(st->tokens, "=")) {
+            ++st->tokens;
+            result->data.vardecl.initial_value = parse_expression(st);
         } else {
-            result.data.vardecl.initial_value = NULL;
+            result->data.vardecl.initial_value = NULL;
         }
     } else {
-        AstExpression expr = parse_expression(tokens);
-        if (is_operator(*tokens, "=")) {
-            ++*tokens;
-            result.kind = AST_STMT_ASSIGN;
-            result.data.assignment = (AstAssignment){.target=expr, .value=parse_expression(tokens)};
-            if (is_operator(*tokens, "="))
-                fail_with_error((*tokens)->location, "only one variable can be assigned at a time");
+        result = new_statement(st, AST_STMT_EXPRESSION_STATEMENT);
+        AstExpression *expr = parse_expression(st);
+        if (is_operator(st->tokens, "=")) {
+            ++st->tokens;
+            result->kind = AST_STMT_ASSIGN;
+            result->data.assignment.target = expr;
+            result->data.assignment.value = parse_expression(st);
+            if (is_operator(st->tokens, "="))
+                fail_with_error(st->tokens->location, "only one variable can be assigned at a time");
         } else {
-            validate_expression_statement(&expr);
-            result.kind = AST_STMT_EXPRESSION_STATEMENT;
-            result.data.expression = expr;
+            validate_expression_statement(expr);
+            result->data.expression = expr;
         }
     }
     return result;
 }
 
-static AstStatement parse_statement(const Token **tokens)
+static AstStatement *parse_statement(struct State *st)
 {
-    AstStatement result = { .location = (*tokens)->location };
-    if (is_keyword(*tokens, "if")) {
-        result.kind = AST_STMT_IF;
-        result.data.ifstatement = parse_if_statement(tokens);
-    } else if (is_keyword(*tokens, "while")) {
-        ++*tokens;
-        result.kind = AST_STMT_WHILE;
-        result.data.whileloop.condition = parse_expression(tokens);
-        result.data.whileloop.body = parse_body(tokens);
-    } else if (is_keyword(*tokens, "for")) {
-        ++*tokens;
-        result.kind = AST_STMT_FOR;
-        result.data.forloop.init = malloc(sizeof *result.data.forloop.init);
-        result.data.forloop.incr = malloc(sizeof *result.data.forloop.incr);
+    AstStatement *result;
+    if (is_keyword(st->tokens, known_names.kw_if)) {
+        result = new_statement(st, AST_STMT_IF);
+        result->data.ifstatement = parse_if_statement(st);
+    } else if (is_keyword(st->tokens, known_names.kw_while)) {
+        result = new_statement(st, AST_STMT_WHILE);
+        ++st->tokens;
+        result->data.whileloop.condition = parse_expression(st);
+        result->data.whileloop.body = parse_body(st);
+    } else if (is_keyword(st->tokens, known_names.kw_for)) {
+        result = new_statement(st, AST_STMT_FOR);
+        ++st->tokens;
         // TODO: improve error messages
-        *result.data.forloop.init = parse_oneline_statement(tokens);
-        if (!is_operator(*tokens, ";"))
-            fail_with_parse_error(*tokens, "a ';'");
-        ++*tokens;
-        result.data.forloop.cond = parse_expression(tokens);
-        if (!is_operator(*tokens, ";"))
-            fail_with_parse_error(*tokens, "a ';'");
-        ++*tokens;
-        *result.data.forloop.incr = parse_oneline_statement(tokens);
-        result.data.forloop.body = parse_body(tokens);
+        result->data.forloop.init = parse_oneline_statement(st);
+        if (!is_operator(st->tokens, ";"))
+            fail_with_parse_error(st->tokens, "a ';'");
+        ++st->tokens;
+        result->data.forloop.cond = parse_expression(st);
+        if (!is_operator(st->tokens, ";"))
+            fail_with_parse_error(st->tokens, "a ';'");
+        ++st->tokens;
+        result->data.forloop.incr = parse_oneline_statement(st);
+        result->data.forloop.body = parse_body(st);
     } else {
-        result = parse_oneline_statement(tokens);
-        eat_newline(tokens);
+        result = parse_oneline_statement(st);
+        eat_newline(st);
     }
     return result;
 }
 
-static void parse_start_of_body(const Token **tokens)
+static void parse_start_of_body(struct State *st)
 {
-    if (!is_operator(*tokens, ":"))
-        fail_with_parse_error(*tokens, "':' followed by a new line with more indentation");
-    ++*tokens;
+    if (!is_operator(st->tokens, ":"))
+        fail_with_parse_error(st->tokens, "':' followed by a new line with more indentation");
+    ++st->tokens;
 
-    if ((*tokens)->type != TOKEN_NEWLINE)
-        fail_with_parse_error(*tokens, "a new line with more indentation after ':'");
-    ++*tokens;
+    if (st->tokens->type != TOKEN_NEWLINE)
+        fail_with_parse_error(st->tokens, "a new line with more indentation after ':'");
+    ++st->tokens;
 
-    if ((*tokens)->type != TOKEN_INDENT)
-        fail_with_parse_error(*tokens, "more indentation after ':'");
-    ++*tokens;
+    if (st->tokens->type != TOKEN_INDENT)
+        fail_with_parse_error(st->tokens, "more indentation after ':'");
+    ++st->tokens;
 }
 
-static AstBody parse_body(const Token **tokens)
+static AstBody parse_body(struct State *st)
 {
-    parse_start_of_body(tokens);
+    parse_start_of_body(st);
 
-    List(AstStatement) result = {0};
-    while ((*tokens)->type != TOKEN_DEDENT)
-        Append(&result, parse_statement(tokens));
-    ++*tokens;
+    List(AstStatement *) result = {0};
+    while (st->tokens->type != TOKEN_DEDENT) {
+        AstStatement *stmt = parse_statement(st);
+        ArenaAppend(st->arena, &result, stmt);
+    }
+    ++st->tokens;
 
     return (AstBody){ .statements=result.ptr, .nstatements=result.len };
 }
 
-static AstStructDef parse_structdef(const Token **tokens)
+static AstStructDef parse_structdef(struct State *st)
 {
     AstStructDef result;
-    if ((*tokens)->type != TOKEN_NAME)
-        fail_with_parse_error(*tokens, "a name for the struct");
-    safe_strcpy(result.name, (*tokens)->data.name);
-    ++*tokens;
+    if (st->tokens->type != TOKEN_NAME)
+        fail_with_parse_error(st->tokens, "a name for the struct");
+    result.name = st->tokens->data.name;
+    ++st->tokens;
 
     NameList fieldnames = {0};
     TypeList fieldtypes = {0};
 
-    parse_start_of_body(tokens);
-    while ((*tokens)->type != TOKEN_DEDENT) {
+    parse_start_of_body(st);
+    while (st->tokens->type != TOKEN_DEDENT) {
         parse_name_and_type(
-            tokens, &fieldnames, &fieldtypes,
+            st, &fieldnames, &fieldtypes,
             "a name for a struct field", "there are multiple fields named '%s'");
-        eat_newline(tokens);
+        eat_newline(st);
     }
-    ++*tokens;
+    ++st->tokens;
 
-    result.fieldnames = (char(*)[100])fieldnames.ptr;
+    result.fieldnames = fieldnames.ptr;
     result.fieldtypes = fieldtypes.ptr;
     assert(fieldnames.len == fieldtypes.len);
     result.nfields = fieldnames.len;
     return result;
 }
 
-static AstToplevelNode parse_toplevel_node(const Token **tokens)
+static AstToplevelNode parse_toplevel_node_from_tokens(struct State *st)
 {
-    AstToplevelNode result = { .location = (*tokens)->location };
+    AstToplevelNode result = { .location = st->tokens->location };
 
-    switch((*tokens)->type) {
+    switch(st->tokens->type) {
     case TOKEN_END_OF_FILE:
         result.kind = AST_TOPLEVEL_END_OF_FILE;
         break;
 
     case TOKEN_KEYWORD:
-        if (is_keyword(*tokens, "def")) {
-            ++*tokens;  // skip 'def' keyword
+        if (is_keyword(st->tokens, known_names.kw_def)) {
+            ++st->tokens;  // skip 'def' keyword
             result.kind = AST_TOPLEVEL_DEFINE_FUNCTION;
-            result.data.funcdef.signature = parse_function_signature(tokens);
+            result.data.funcdef.signature = parse_function_signature(st);
             if (result.data.funcdef.signature.takes_varargs) {
                 // TODO: support "def foo(x: str, ...)" in some way
-                fail_with_error((*tokens)->location, "functions with variadic arguments cannot be defined yet");
+                fail_with_error(st->tokens->location, "functions with variadic arguments cannot be defined yet");
             }
-            result.data.funcdef.body = parse_body(tokens);
+            result.data.funcdef.body = parse_body(st);
             break;
         }
-        if (is_keyword(*tokens, "declare")) {
-            ++*tokens;
+        if (is_keyword(st->tokens, known_names.kw_declare)) {
+            ++st->tokens;
             result.kind = AST_TOPLEVEL_DECLARE_FUNCTION;
-            result.data.decl_signature = parse_function_signature(tokens);
-            eat_newline(tokens);
+            result.data.decl_signature = parse_function_signature(st);
+            eat_newline(st);
             break;
         }
-        if (is_keyword(*tokens, "struct")) {
-            ++*tokens;
+        if (is_keyword(st->tokens, known_names.kw_struct)) {
+            ++st->tokens;
             result.kind = AST_TOPLEVEL_DEFINE_STRUCT;
-            result.data.structdef = parse_structdef(tokens);
+            result.data.structdef = parse_structdef(st);
             break;
         }
         __attribute__((fallthrough));
 
     default:
-        fail_with_parse_error(*tokens, "a definition or declaration");
+        fail_with_parse_error(st->tokens, "a definition or declaration");
     }
 
     return result;
 }   
 
-AstToplevelNode *parse(const Token *tokens)
+AstToplevelNode parse_toplevel_node(TokenStream *ts, Arena *arena)
 {
-    List(AstToplevelNode) result = {0};
-    do {
-        Append(&result, parse_toplevel_node(&tokens));
-    } while (result.ptr[result.len - 1].kind != AST_TOPLEVEL_END_OF_FILE);
-
-    return result.ptr;
+    struct State st = { .tokens = read_toplevel_tokens(ts), .arena = arena };
+    AstToplevelNode result = parse_toplevel_node_from_tokens(&st);
+    unread_tokens(ts, st.tokens);
+    return result;
 }
@@ -202,7 +202,7 @@ static void print_ast_expression(const AstExpression *expr, struct TreePrinter t
     }
 
     for (int i = 0; i < n; i++)
-        print_ast_expression(&expr->data.operands[i], print_tree_prefix(tp, i==n-1));
+        print_ast_expression(expr->data.operands[i], print_tree_prefix(tp, i==n-1));
 }
 
 static void print_ast_call(const AstCall *call, struct TreePrinter tp)
@@ -213,7 +213,7 @@ static void print_ast_call(const AstCall *call, struct TreePrinter tp)
             printf("argument \"%s\": ", call->argnames[i]);
         else
             printf("argument %d: ", i);
-        print_ast_expression(&call->args[i], sub);
+        print_ast_expression(call->args[i], sub);
     }
 }
 
@@ -228,11 +228,11 @@ static void print_ast_statement(const AstStatement *stmt, struct TreePrinter tp)
     switch(stmt->kind) {
         case AST_STMT_EXPRESSION_STATEMENT:
             printf("expression statement\n");
-            print_ast_expression(&stmt->data.expression, print_tree_prefix(tp, true));
+            print_ast_expression(stmt->data.expression, print_tree_prefix(tp, true));
             break;
         case AST_STMT_RETURN_VALUE:
             printf("return a value\n");
-            print_ast_expression(&stmt->data.expression, print_tree_prefix(tp, true));
+            print_ast_expression(stmt->data.expression, print_tree_prefix(tp, true));
             break;
         case AST_STMT_RETURN_WITHOUT_VALUE:
             printf("return without a value\n");
@@ -242,7 +242,7 @@ static void print_ast_statement(const AstStatement *stmt, struct TreePrinter tp)
             for (int i = 0; i < stmt->data.ifstatement.n_if_and_elifs; i++) {
                 sub = print_tree_prefix(tp, false);
                 printf("condition: ");
-                print_ast_expression(&stmt->data.ifstatement.if_and_elifs[i].condition, sub);
+                print_ast_expression(stmt->data.ifstatement.if_and_elifs[i].condition, sub);
 
                 bool is_last_row = (
                     i == stmt->data.ifstatement.n_if_and_elifs-1
@@ -261,7 +261,7 @@ static void print_ast_statement(const AstStatement *stmt, struct TreePrinter tp)
             printf("while\n");
             sub = print_tree_prefix(tp, true);
             printf("condition: ");
-            print_ast_expression(&stmt->data.whileloop.condition, sub);
+            print_ast_expression(stmt->data.whileloop.condition, sub);
             sub = print_tree_prefix(tp, true);
             printf("body:\n");
             print_ast_body(&stmt->data.whileloop.body, sub);
@@ -273,7 +273,7 @@ static void print_ast_statement(const AstStatement *stmt, struct TreePrinter tp)
             print_ast_statement(stmt->data.forloop.init, sub);
             sub = print_tree_prefix(tp, false);
             printf("cond: ");
-            print_ast_expression(&stmt->data.forloop.cond, sub);
+            print_ast_expression(stmt->data.forloop.cond, sub);
             sub = print_tree_prefix(tp, false);
             printf("incr: ");
             print_ast_statement(stmt->data.forloop.incr, sub);
@@ -301,8 +301,8 @@ static void print_ast_statement(const AstStatement *stmt, struct TreePrinter tp)
             break;
         case AST_STMT_ASSIGN:
             printf("assign\n");
-            print_ast_expression(&stmt->data.assignment.target, print_tree_prefix(tp, false));
-            print_ast_expression(&stmt->data.assignment.value, print_tree_prefix(tp, true));
+            print_ast_expression(stmt->data.assignment.target, print_tree_prefix(tp, false));
+            print_ast_expression(stmt->data.assignment.value, print_tree_prefix(tp, true));
             break;
     }
 }
@@ -310,53 +310,49 @@ static void print_ast_statement(const AstStatement *stmt, struct TreePrinter tp)
 static void print_ast_body(const AstBody *body, struct TreePrinter tp)
 {
     for (int i = 0; i < body->nstatements; i++)
-        print_ast_statement(&body->statements[i], print_tree_prefix(tp, i == body->nstatements - 1));
+        print_ast_statement(body->statements[i], print_tree_prefix(tp, i == body->nstatements - 1));
 }
 
-void print_ast(const AstToplevelNode *topnodelist)
+void print_ast(const AstToplevelNode *topnode)
 {
-    printf("===== AST for file \"%s\" =====\n", topnodelist->location.filename);
+    printf("===== AST for line %d of file \"%s\" =====\n", topnode->location.lineno, topnode->location.filename);
+    printf("line %d: ", topnode->location.lineno);
 
-    do {
-        printf("line %d: ", topnodelist->location.lineno);
-
-        switch(topnodelist->kind) {
-            case AST_TOPLEVEL_DECLARE_FUNCTION:
-                printf("Declare a function: ");
-                print_ast_function_signature(&topnodelist->data.decl_signature);
-                break;
-            case AST_TOPLEVEL_DEFINE_FUNCTION:
-                printf("Define a function: ");
-                print_ast_function_signature(&topnodelist->data.funcdef.signature);
-                print_ast_body(&topnodelist->data.funcdef.body, (struct TreePrinter){0});
-                break;
-            case AST_TOPLEVEL_DEFINE_STRUCT:
-                printf("Define struct \"%s\" with %d fields:\n",
-                    topnodelist->data.structdef.name, topnodelist->data.structdef.nfields);
-                for (int i = 0; i < topnodelist->data.structdef.nfields; i++) {
-                    printf("  %s: ", topnodelist->data.structdef.fieldnames[i]);
-                    print_ast_type(&topnodelist->data.structdef.fieldtypes[i]);
-                    printf("\n");
-                }
-                break;
-            case AST_TOPLEVEL_END_OF_FILE:
-                printf("End of file.\n");
-                break;
-        }
-        printf("\n");
-
-    } while (topnodelist++->kind != AST_TOPLEVEL_END_OF_FILE);
+    switch(topnode->kind) {
+        case AST_TOPLEVEL_DECLARE_FUNCTION:
+            printf("Declare a function: ");
+            print_ast_function_signature(&topnode->data.decl_signature);
+            break;
+        case AST_TOPLEVEL_DEFINE_FUNCTION:
+            printf("Define a function: ");
+            print_ast_function_signature(&topnode->data.funcdef.signature);
+            print_ast_body(&topnode->data.funcdef.body, (struct TreePrinter){0});
+            break;
+        case AST_TOPLEVEL_DEFINE_STRUCT:
+            printf("Define struct \"%s\" with %d fields:\n",
+                topnode->data.structdef.name, topnode->data.structdef.nfields);
+            for (int i = 0; i < topnode->data.structdef.nfields; i++) {
+                printf("  %s: ", topnode->data.structdef.fieldnames[i]);
+                print_ast_type(&topnode->data.structdef.fieldtypes[i]);
+                printf("\n");
+            }
+            break;
+        case AST_TOPLEVEL_END_OF_FILE:
+            printf("End of file.\n");
+            break;
+    }
+    printf("\n");
 }
 
 
 static const char *varname(const Variable *var)
 {
-    if (var->name[0])
+    if (var->name)
         return var->name;
 
     // Cycle through enough space for a few variables, so that you
     // can call this several times inside the same printf()
-    static char names[50 + sizeof var->name][5];
+    static char names[5][50];
     static unsigned i = 0;
     char *s = names[i++];
     i %= sizeof(names) / sizeof(names[0]);
@@ -380,7 +376,7 @@ static void print_cf_instruction(const CfInstruction *ins, int indent)
         printf("boolean negation of %s", varname(ins->operands[0]));
         break;
     case CF_CALL:
-        printf("call %s(", ins->data.funcname);
+        printf("call %s(", ins->data.call.funcname);
         for (int i = 0; i < ins->noperands; i++) {
             if(i) printf(", ");
             printf("%s", varname(ins->operands[i]));
@@ -408,6 +404,8 @@ static void print_cf_instruction(const CfInstruction *ins, int indent)
     case CF_INT_EQ:
     case CF_INT_LT:
     case CF_PTR_EQ:
+    case CF_BOOL_AND:
+    case CF_BOOL_OR:
         switch(ins->kind){
             case CF_INT_ADD: printf("iadd "); break;
             case CF_INT_SUB: printf("isub "); break;
@@ -417,6 +415,8 @@ static void print_cf_instruction(const CfInstruction *ins, int indent)
             case CF_INT_EQ: printf("ieq "); break;
             case CF_INT_LT: printf("ilt "); break;
             case CF_PTR_EQ: printf("ptreq "); break;
+            case CF_BOOL_AND: printf("band "); break;
+            case CF_BOOL_OR: printf("bor "); break;
             default: assert(0);
         }
         printf("%s, %s", varname(ins->operands[0]), varname(ins->operands[1]));
@@ -432,7 +432,7 @@ static void print_cf_instruction(const CfInstruction *ins, int indent)
         printf("ptr %s + integer %s", varname(ins->operands[0]), varname(ins->operands[1]));
         break;
     case CF_PTR_STRUCT_FIELD:
-        printf("%s + offset of field \"%s\"", varname(ins->operands[0]), ins->data.fieldname);
+        printf("%s + offset of field \"%s\"", varname(ins->operands[0]), ins->data.field.fieldname);
         break;
     case CF_PTR_CAST:
         printf("pointer cast %s", varname(ins->operands[0]));
@@ -457,7 +457,7 @@ static void print_control_flow_graph_with_indent(const CfGraph *cfg, int indent)
 
     printf("%*sVariables:\n", indent, "");
     for (Variable **var = cfg->variables.ptr; var < End(cfg->variables); var++) {
-        printf("%*s  %-20s  %s\n", indent, "", varname(*var), (*var)->type->name);
+        printf("%*s  %-20s  %s\n", indent, "", varname(*var), type_name((*var)->type));
     }
 
     for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++) {
@@ -500,16 +500,23 @@ void print_control_flow_graph(const CfGraph *cfg)
     print_control_flow_graph_with_indent(cfg, 0);
 }
 
-void print_control_flow_graphs(const CfGraphFile *cfgfile)
+void print_function_control_flow_graph(const Signature *sig, const CfGraph *cfg)
 {
-    printf("===== Control Flow Graphs for file \"%s\" =====\n", cfgfile->filename);
-    for (int i = 0; i < cfgfile->nfuncs; i++) {
-        char *sigstr = signature_to_string(&cfgfile->signatures[i], true);
-        printf("Function %s\n", sigstr);
-        free(sigstr);
-        print_control_flow_graph_with_indent(cfgfile->graphs[i], 2);
-        printf("\n");
-    }
+    printf("===== Control Flow Graph for function \"%s\" =====\n", sig->funcname);
+    char *sigstr = signature_to_string(sig, true);
+    printf("Function %s\n", sigstr);
+    free(sigstr);
+    print_control_flow_graph_with_indent(cfg, 2);
+    printf("\n");
+}
+
+void print_function_stats(const Signature *sig, const FunctionStats *stats)
+{
+    printf("===== Stats for function \"%s\" =====\n", sig->funcname);
+    printf("  variable status analyses: %d\n", stats->var_status_analyses);
+    printf("  fixpoint iterations: %d\n", stats->fixpoint_iterations);
+    printf("  stack space for variables: %d bytes (%d bytes without sharing)\n", stats->stack_bytes, stats->stack_bytes_without_sharing);
+    printf("\n");
 }
 
 
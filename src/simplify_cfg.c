@@ -1,20 +1,111 @@
 #include "jou_compiler.h"
 #include <limits.h>
+#include <stdint.h>
 
-static int find_block_index(const CfGraph *cfg, const CfBlock *b)
+/*
+Block and variable indexes needed by the analysis below, computed once so
+that it never has to search for a block or a variable.
+
+The blocks jumping to block b are preds[predstart[b]], ..., preds[predstart[b+1]-1].
+*/
+struct CfgIndexes {
+    int *successors;  // successors[2*b] and successors[2*b+1] for iftrue and iffalse, -1 for end block
+    int *predstart;
+    int *preds;
+    bool *reachable;
+    int end_block_index;
+    int *var_indexes_by_id;  // var_indexes_by_id[v->id] == index of v in cfg->variables
+};
+
+// Variable IDs don't change, but variables are moved around in cfg->variables when unused variables are removed.
+static int *map_var_ids_to_indexes(const CfGraph *cfg)
 {
-    for (int i = 0; i < cfg->all_blocks.len; i++)
-        if (cfg->all_blocks.ptr[i] == b)
-            return i;
-    assert(0);
+    int maxid = -1;
+    for (int i = 0; i < cfg->variables.len; i++)
+        maxid = max(maxid, cfg->variables.ptr[i]->id);
+    int *result = malloc(sizeof(result[0]) * (maxid + 1));  // NOLINT
+    for (int i = 0; i < cfg->variables.len; i++)
+        result[cfg->variables.ptr[i]->id] = i;
+    return result;
 }
 
-static int find_var_index(const CfGraph *cfg, const Variable *v)
+static struct CfgIndexes compute_indexes(const CfGraph *cfg)
 {
-    for (int i = 0; i < cfg->variables.len; i++)
-        if (cfg->variables.ptr[i] == v)
-            return i;
-    assert(0);
+    int nblocks = cfg->all_blocks.len;
+    struct CfgIndexes ind;
+
+    int maxid = -1;
+    for (int i = 0; i < nblocks; i++)
+        maxid = max(maxid, cfg->all_blocks.ptr[i]->id);
+    int *block_indexes_by_id = malloc(sizeof(block_indexes_by_id[0]) * (maxid + 1));  // NOLINT
+    for (int id = 0; id <= maxid; id++)
+        block_indexes_by_id[id] = -1;
+    for (int i = 0; i < nblocks; i++)
+        block_indexes_by_id[cfg->all_blocks.ptr[i]->id] = i;
+
+    ind.successors = malloc(sizeof(ind.successors[0]) * 2 * nblocks);  // NOLINT
+    ind.predstart = calloc(sizeof(ind.predstart[0]), nblocks + 1);
+    ind.end_block_index = -1;
+    for (int i = 0; i < nblocks; i++) {
+        const CfBlock *b = cfg->all_blocks.ptr[i];
+        if (b == &cfg->end_block)
+            ind.end_block_index = i;
+        for (int k = 0; k < 2; k++) {
+            const CfBlock *target = k ? b->iffalse : b->iftrue;
+            if (b == &cfg->end_block) {
+                ind.successors[2*i + k] = -1;
+                continue;
+            }
+            int targetidx = block_indexes_by_id[target->id];
+            assert(targetidx != -1 && cfg->all_blocks.ptr[targetidx] == target);
+            ind.successors[2*i + k] = targetidx;
+            ind.predstart[targetidx + 1]++;
+        }
+    }
+    free(block_indexes_by_id);
+    assert(ind.end_block_index != -1);
+
+    // A block that jumps to the same place in both cases is still only one predecessor,
+    // but listing it twice doesn't matter, because merging the same statuses twice does nothing.
+    for (int i = 0; i < nblocks; i++)
+        ind.predstart[i+1] += ind.predstart[i];
+    ind.preds = malloc(sizeof(ind.preds[0]) * (ind.predstart[nblocks] + 1));  // NOLINT
+    int *fill = malloc(sizeof(fill[0]) * nblocks);  // NOLINT
+    memcpy(fill, ind.predstart, sizeof(fill[0]) * nblocks);
+    for (int i = 0; i < 2*nblocks; i++)
+        if (ind.successors[i] != -1)
+            ind.preds[fill[ind.successors[i]]++] = i/2;
+    free(fill);
+
+    // Depth-first search from the start block to find reachable blocks.
+    ind.reachable = calloc(sizeof(ind.reachable[0]), nblocks);
+    int *stack = malloc(sizeof(stack[0]) * nblocks);  // NOLINT
+    int stacklen = 0;
+    stack[stacklen++] = 0;
+    ind.reachable[0] = true;
+    while (stacklen) {
+        int b = stack[--stacklen];
+        for (int k = 0; k < 2; k++) {
+            int next = ind.successors[2*b + k];
+            if (next != -1 && !ind.reachable[next]) {
+                ind.reachable[next] = true;
+                stack[stacklen++] = next;
+            }
+        }
+    }
+    free(stack);
+
+    ind.var_indexes_by_id = map_var_ids_to_indexes(cfg);
+    return ind;
+}
+
+static void free_indexes(const struct CfgIndexes *ind)
+{
+    free(ind->successors);
+    free(ind->predstart);
+    free(ind->preds);
+    free(ind->reachable);
+    free(ind->var_indexes_by_id);
 }
 
 enum VarStatus {
@@ -35,7 +126,7 @@ enum VarStatus {
 
 /*
 a and b are statuses from different branches that both jump to the same block.
-Should have these properties:
+Merging them should have these properties:
 
     merge(a, VS_UNVISITED) == a
     merge(a, a) == a
@@ -46,77 +137,132 @@ In other words:
 - It makes sense to merge an unordered collection of statuses.
 - VS_UNVISITED corresponds with merging an empty set of statuses.
 - Having the same status several times doesn't affect anything.
+
+To get these properties, a status is stored as a set of things that the variable
+can be. For example, VS_POSSIBLY_UNDEFINED is {defined, undefined}, and merging
+is just taking the union of the sets. See get_status() for how a set turns back
+into a VarStatus. For example, {true, false} means VS_DEFINED, and the set of
+every possibility includes "unpredictable", so it means VS_UNPREDICTABLE.
+
+The statuses of all variables are stored as bit planes: one bit per variable
+for each of the things a variable can be. Merging two arrays of statuses is
+then a bitwise OR over a few machine words.
 */
-static enum VarStatus merge(enum VarStatus a, enum VarStatus b)
+enum VarPossibility { VP_TRUE, VP_FALSE, VP_DEFINED, VP_UNDEFINED, VP_UNPREDICTABLE, VP_COUNT };
+
+typedef uint64_t StatusWord;
+#define BITS_PER_WORD 64
+
+// Statuses of all variables are nwords_per_plane*VP_COUNT words.
+struct VarStatuses {
+    int nblocks, nvars, nwords_per_plane;
+    StatusWord *words;  // statuses at end of each block, one after another
+    int nvisits;  // how many times a block was analyzed
+};
+
+static int words_per_block(const struct VarStatuses *vs)
 {
-    // Unvisited --> use the other status
-    if (a == VS_UNVISITED) return b;
-    if (b == VS_UNVISITED) return a;
+    return vs->nwords_per_plane * VP_COUNT;
+}
 
-    // If any value in a merge is unpredictable or undefined, then the result is also
-    // unpredictable/undefined.
-    // If there are unpredictable and undefined values, the merge is unpredictable.
-    if (a == VS_UNPREDICTABLE || b == VS_UNPREDICTABLE) return VS_UNPREDICTABLE;
-    if (a == VS_UNDEFINED && b == VS_UNDEFINED) return VS_UNDEFINED;
-    if (a == VS_UNDEFINED || b == VS_UNDEFINED || a == VS_POSSIBLY_UNDEFINED || b == VS_POSSIBLY_UNDEFINED) return VS_POSSIBLY_UNDEFINED;
+static StatusWord *statuses_of_block(const struct VarStatuses *vs, int blockidx)
+{
+    return &vs->words[(size_t)blockidx * words_per_block(vs)];
+}
 
-    // At this point we know that the value is set to something. We may or may not know
-    // what it is set to.
-    assert(a == VS_TRUE || a == VS_FALSE || a == VS_DEFINED);
-    assert(b == VS_TRUE || b == VS_FALSE || b == VS_DEFINED);
-    if (a == VS_TRUE && b == VS_TRUE) return VS_TRUE;
-    if (a == VS_FALSE && b == VS_FALSE) return VS_FALSE;
-    return VS_DEFINED;
+static bool has_possibility(const struct VarStatuses *vs, const StatusWord *statuses, int varidx, enum VarPossibility p)
+{
+    StatusWord w = statuses[p*vs->nwords_per_plane + varidx/BITS_PER_WORD];
+    return (w >> (varidx % BITS_PER_WORD)) & 1;
 }
 
-static bool merge_arrays_in_place(enum VarStatus *dest, const enum VarStatus *src, int n)
+static enum VarStatus get_status(const struct VarStatuses *vs, const StatusWord *statuses, int varidx)
 {
-    bool did_something = false;
-    for (int i = 0; i < n; i++) {
-        enum VarStatus m = merge(src[i], dest[i]);
-        if (dest[i] != m) {
-            dest[i] = m;
-            did_something = true;
-        }
+#define Has(p) has_possibility(vs, statuses, varidx, (p))
+    if (Has(VP_UNPREDICTABLE))
+        return VS_UNPREDICTABLE;
+    if (Has(VP_UNDEFINED))
+        return (Has(VP_TRUE) || Has(VP_FALSE) || Has(VP_DEFINED)) ? VS_POSSIBLY_UNDEFINED : VS_UNDEFINED;
+    if (Has(VP_DEFINED) || (Has(VP_TRUE) && Has(VP_FALSE)))
+        return VS_DEFINED;
+    if (Has(VP_TRUE))
+        return VS_TRUE;
+    if (Has(VP_FALSE))
+        return VS_FALSE;
+    return VS_UNVISITED;
+#undef Has
+}
+
+static void set_status(const struct VarStatuses *vs, StatusWord *statuses, int varidx, enum VarStatus status)
+{
+    unsigned possibilities = 0;
+    switch(status) {
+        case VS_UNVISITED: break;
+        case VS_TRUE: possibilities = 1 << VP_TRUE; break;
+        case VS_FALSE: possibilities = 1 << VP_FALSE; break;
+        case VS_DEFINED: possibilities = 1 << VP_DEFINED; break;
+        case VS_POSSIBLY_UNDEFINED: possibilities = (1 << VP_DEFINED) | (1 << VP_UNDEFINED); break;
+        case VS_UNDEFINED: possibilities = 1 << VP_UNDEFINED; break;
+        case VS_UNPREDICTABLE: possibilities = 1 << VP_UNPREDICTABLE; break;
     }
 
-    return did_something;
+    StatusWord bit = (StatusWord)1 << (varidx % BITS_PER_WORD);
+    for (int p = 0; p < VP_COUNT; p++) {
+        StatusWord *w = &statuses[p*vs->nwords_per_plane + varidx/BITS_PER_WORD];
+        if (possibilities & (1 << p))
+            *w |= bit;
+        else
+            *w &= ~bit;
+    }
 }
 
-// Figure out how an instruction affects variables when it runs.
-static void update_statuses_with_instruction(const CfGraph *cfg, enum VarStatus *statuses, const CfInstruction *ins)
+// Returns true if dest changed.
+static bool merge_statuses_in_place(const struct VarStatuses *vs, StatusWord *restrict dest, const StatusWord *restrict src)
 {
-    for (int i = 0; i < cfg->variables.len; i++)
-        assert(statuses[i] != VS_UNVISITED);
+    StatusWord changed = 0;
+    for (int i = 0; i < words_per_block(vs); i++) {
+        changed |= src[i] & ~dest[i];
+        dest[i] |= src[i];
+    }
+    return changed != 0;
+}
 
+// Figure out how an instruction affects variables when it runs.
+static void update_statuses_with_instruction(
+    const struct VarStatuses *vs, const struct CfgIndexes *ind, StatusWord *statuses, const CfInstruction *ins)
+{
     if (!ins->destvar)
         return;
 
-    int destidx = find_var_index(cfg, ins->destvar);
-    if (statuses[destidx] == VS_UNPREDICTABLE)
+    int destidx = ind->var_indexes_by_id[ins->destvar->id];
+    assert(get_status(vs, statuses, destidx) != VS_UNVISITED);
+    if (get_status(vs, statuses, destidx) == VS_UNPREDICTABLE)
         return;
 
+    enum VarStatus s;
     switch(ins->kind) {
     case CF_VARCPY:
-        statuses[destidx] = statuses[find_var_index(cfg, ins->operands[0])];
-        if (statuses[destidx] == VS_UNPREDICTABLE) {
+        s = get_status(vs, statuses, ind->var_indexes_by_id[ins->operands[0]->id]);
+        assert(s != VS_UNVISITED);
+        if (s == VS_UNPREDICTABLE) {
             // Assume that unpredictable variables always yield non-garbage values.
             // Otherwise using functions like scanf() would be annoying.
-            statuses[destidx] = VS_DEFINED;
+            s = VS_DEFINED;
         }
+        set_status(vs, statuses, destidx, s);
         break;
     case CF_ADDRESS_OF_VARIABLE:
-        statuses[find_var_index(cfg, ins->operands[0])] = VS_UNPREDICTABLE;
-        statuses[destidx] = VS_DEFINED;
+        set_status(vs, statuses, ind->var_indexes_by_id[ins->operands[0]->id], VS_UNPREDICTABLE);
+        set_status(vs, statuses, destidx, VS_DEFINED);
         break;
     case CF_CONSTANT:
         if (ins->data.constant.kind == CONSTANT_BOOL)
-            statuses[destidx] = ins->data.constant.data.boolean ? VS_TRUE : VS_FALSE;
+            set_status(vs, statuses, destidx, ins->data.constant.data.boolean ? VS_TRUE : VS_FALSE);
         else
-            statuses[destidx] = VS_DEFINED;
+            set_status(vs, statuses, destidx, VS_DEFINED);
         break;
     default:
-        statuses[destidx] = VS_DEFINED;
+        set_status(vs, statuses, destidx, VS_DEFINED);
         break;
     }
 }
@@ -137,234 +283,818 @@ static const char * vs_to_string(enum VarStatus vs)
     }
     assert(0);
 }
-static void print_var_statuses(const CfGraph *cfg, enum VarStatus **statuses, const enum VarStatus *temp, const char *description)
+static void print_var_statuses(const CfGraph *cfg, const struct VarStatuses *vs, const StatusWord *temp, const char *description)
 {
-    int nblocks = cfg->all_blocks.len;
-    int nvars = cfg->variables.len;
-
     puts(description);
-    for (int blockidx = 0; blockidx < nblocks; blockidx++) {
+    for (int blockidx = 0; blockidx < vs->nblocks; blockidx++) {
         printf("  block %d:\n", blockidx);
-        for (int i = 0; i < nvars; i++)
-            printf("    %-15s  %s\n", cfg->variables.ptr[i]->name, vs_to_string(statuses[blockidx][i]));
+        for (int i = 0; i < vs->nvars; i++)
+            printf("    %-15s  %s\n", cfg->variables.ptr[i]->name ? cfg->variables.ptr[i]->name : "",
+                vs_to_string(get_status(vs, statuses_of_block(vs, blockidx), i)));
     }
     if(temp) {
         printf("  temp:\n");
-        for (int i = 0; i < nvars; i++)
-            printf("    %-15s  %s\n", cfg->variables.ptr[i]->name, vs_to_string(temp[i]));
+        for (int i = 0; i < vs->nvars; i++)
+            printf("    %-15s  %s\n", cfg->variables.ptr[i]->name ? cfg->variables.ptr[i]->name : "", vs_to_string(get_status(vs, temp, i)));
     }
     printf("\n");
 }
 #endif  // DebugPrint
 
-static bool all_zero(const char *ptr, int n)
-{
-    for (int i = 0; i < n; i++)
-        if (ptr[i])
-            return false;
-    return true;
-}
-
 /*
-Figure out whether boolean variables are true or false.
-return_value[block_index][variable_index] = status of variable at END of block
-variable_index must be so that the variable has type bool.
+Figure out whether variables are defined, and whether boolean variables are true or false.
+The result contains the status of each variable at the END of each block.
 
-Idea: Initially mark everything as possible, so all variables can be true or false.
-Loop through instructions of start block, filtering out impossible options: for
-example, if a variable is set to True, then it can be True and cannot be False.
+Idea: Start with the arguments defined and other variables undefined. Loop through
+instructions of start block, figuring out what each instruction does to the variables:
+for example, if a variable is set to True, then it can be True and cannot be False.
 Repeat for blocks where execution jumps from the current block, unless we got same
 result as last time, then we know that we don't have to reanalyze blocks where
 execution jumps from the current block.
+
+The order of visiting blocks matters, because instructions like "x = y" turn
+an unpredictable y into a defined x, so a block can give different results
+depending on what we know about its variables when it is analyzed. Blocks
+waiting to be analyzed are kept in a bitset, and the block with the smallest
+index is always analyzed first.
 */
-static enum VarStatus **determine_var_statuses(const CfGraph *cfg)
+static struct VarStatuses determine_var_statuses(const CfGraph *cfg, const struct CfgIndexes *ind)
 {
 #if DebugPrint
     print_control_flow_graph(cfg);
     printf("\n");
 #endif
 
-    int nblocks = cfg->all_blocks.len;
-    int nvars = cfg->variables.len;
-
-    enum VarStatus **result = malloc(sizeof(result[0]) * nblocks);  // NOLINT
-    for (int i = 0; i < nblocks; i++)
-        result[i] = calloc(sizeof(result[i][0]), nvars);
+    struct VarStatuses vs = {
+        .nblocks = cfg->all_blocks.len,
+        .nvars = cfg->variables.len,
+        .nwords_per_plane = (cfg->variables.len + BITS_PER_WORD - 1) / BITS_PER_WORD,
+    };
+    vs.words = calloc(sizeof(vs.words[0]), (size_t)vs.nblocks * words_per_block(&vs) + 1);
 
-    char *blocks_to_visit = calloc(1, nblocks);
-    blocks_to_visit[0] = true;  // visit initial block
+    // Bit i is set when the block with index i needs to be visited.
+    int nblocks = vs.nblocks;
+    StatusWord *blocks_to_visit = calloc(sizeof(blocks_to_visit[0]), nblocks/BITS_PER_WORD + 1);
+    blocks_to_visit[0] = 1;  // visit initial block
+    int first_word_to_check = 0;
 
-    enum VarStatus *tempstatus = malloc(nvars*sizeof(tempstatus[0]));
+    StatusWord *tempstatus = malloc(sizeof(tempstatus[0]) * (words_per_block(&vs) + 1));
 
-    while(!all_zero(blocks_to_visit, nblocks)){
+    while(1) {
         // Find a block to visit.
-        int visiting = 0;
-        while (!blocks_to_visit[visiting]) visiting++;
+        while (first_word_to_check <= nblocks/BITS_PER_WORD && !blocks_to_visit[first_word_to_check])
+            first_word_to_check++;
+        if (first_word_to_check > nblocks/BITS_PER_WORD)
+            break;
+        int visiting = first_word_to_check*BITS_PER_WORD + __builtin_ctzll(blocks_to_visit[first_word_to_check]);
+        blocks_to_visit[first_word_to_check] &= blocks_to_visit[first_word_to_check] - 1;  // clear lowest bit
 #if DebugPrint
         printf("=== Visit block %d ===\n", visiting);
 #endif
-        blocks_to_visit[visiting] = false;
         const CfBlock *visitingblock = cfg->all_blocks.ptr[visiting];
+        vs.nvisits++;
 
         // Determine initial values based on other blocks that jump here.
-        for (int i = 0; i < nvars; i++) {
-            if (visiting == 0) {
-                // start block
-                tempstatus[i] = cfg->variables.ptr[i]->is_argument ? VS_DEFINED : VS_UNDEFINED;
-            } else {
-                // What is possible in other blocks is determined based on only how
-                // they are jumped into.
-                tempstatus[i] = VS_UNVISITED;
-            }
+        memset(tempstatus, 0, sizeof(tempstatus[0]) * words_per_block(&vs));
+        if (visiting == 0) {
+            // start block
+            for (int i = 0; i < vs.nvars; i++)
+                set_status(&vs, tempstatus, i, cfg->variables.ptr[i]->is_argument ? VS_DEFINED : VS_UNDEFINED);
         }
 
 #if DebugPrint
-        print_var_statuses(cfg, result, tempstatus, "Initial");
+        print_var_statuses(cfg, &vs, tempstatus, "Initial");
 #endif
 
-        for (int i = 0; i < nblocks; i++) {
-            if (cfg->all_blocks.ptr[i]->iftrue == visitingblock
-                || cfg->all_blocks.ptr[i]->iffalse == visitingblock)
-            {
-                // TODO: If we only get here from the true jump, or only from false
-                // jump, we could assume that the variable used in the jump was true/false.
-                merge_arrays_in_place(tempstatus, result[i], nvars);
-            }
-        }
+        // What is possible in other blocks is determined based on only how they are jumped into.
+        // TODO: If we only get here from the true jump, or only from false
+        // jump, we could assume that the variable used in the jump was true/false.
+        for (int i = ind->predstart[visiting]; i < ind->predstart[visiting + 1]; i++)
+            merge_statuses_in_place(&vs, tempstatus, statuses_of_block(&vs, ind->preds[i]));
 
 #if DebugPrint
-        print_var_statuses(cfg, result, tempstatus, "After adding from other blocks to temp");
+        print_var_statuses(cfg, &vs, tempstatus, "After adding from other blocks to temp");
 #endif
 
         // Turn the initial status into status at end of the block.
         const CfInstruction *ins;
         for (ins = visitingblock->instructions.ptr; ins < End(visitingblock->instructions); ins++)
-        {
-            update_statuses_with_instruction(cfg, tempstatus, ins);
-        }
+            update_statuses_with_instruction(&vs, ind, tempstatus, ins);
 
         // Update what we learned about variable status at end of this block.
-        bool result_affected = merge_arrays_in_place(result[visiting], tempstatus, nvars);
+        bool result_affected = merge_statuses_in_place(&vs, statuses_of_block(&vs, visiting), tempstatus);
 #if DebugPrint
-        print_var_statuses(cfg, result, NULL, "At end");
+        print_var_statuses(cfg, &vs, NULL, "At end");
 #endif
 
         if (result_affected && visitingblock != &cfg->end_block) {
             // Also need to update blocks where we jump from here.
+            for (int k = 0; k < 2; k++) {
+                int next = ind->successors[2*visiting + k];
 #if DebugPrint
-            printf("  Will visit %d and %d\n", find_block_index(cfg, visitingblock->iftrue), find_block_index(cfg, visitingblock->iffalse));
+                printf("  Will visit %d\n", next);
 #endif
-            blocks_to_visit[find_block_index(cfg, visitingblock->iftrue)] = true;
-            blocks_to_visit[find_block_index(cfg, visitingblock->iffalse)] = true;
+                blocks_to_visit[next / BITS_PER_WORD] |= (StatusWord)1 << (next % BITS_PER_WORD);
+                first_word_to_check = min(first_word_to_check, next / BITS_PER_WORD);
+            }
         }
     }
 
     free(blocks_to_visit);
     free(tempstatus);
-    return result;
+    return vs;
+}
+
+struct State {
+    CfGraph *cfg;
+    FunctionStats *stats;
+
+    /*
+    Indexes and variable statuses are computed only when needed, and then reused
+    until blocks or jumps change. Removing unused variables doesn't invalidate
+    them, because ind.var_indexes_by_id doesn't change when variables move
+    around in cfg->variables.
+    */
+    bool analysis_valid;
+    struct CfgIndexes ind;
+    struct VarStatuses vs;
+};
+
+static void analyze(struct State *st)
+{
+    if (st->analysis_valid)
+        return;
+    st->ind = compute_indexes(st->cfg);
+    st->vs = determine_var_statuses(st->cfg, &st->ind);
+    st->analysis_valid = true;
+    st->stats->var_status_analyses++;
+    st->stats->fixpoint_iterations += st->vs.nvisits;
 }
 
-static void free_var_statuses(const CfGraph *cfg, enum VarStatus** statuses)
+// Call this after changing blocks or jumps between them.
+static void invalidate_analysis(struct State *st)
 {
-    for (int i = 0; i < cfg->all_blocks.len; i++)
-        free(statuses[i]);
-    free(statuses);
+    if (st->analysis_valid) {
+        free(st->vs.words);
+        free_indexes(&st->ind);
+        st->analysis_valid = false;
+    }
 }
 
-static void clean_jumps_where_condition_always_true_or_always_false(CfGraph *cfg)
+static enum VarStatus status_at_end_of_block(const struct State *st, int blockidx, const Variable *v)
 {
-    enum VarStatus **statuses = determine_var_statuses(cfg);
+    assert(st->analysis_valid);
+    return get_status(&st->vs, statuses_of_block(&st->vs, blockidx), st->ind.var_indexes_by_id[v->id]);
+}
 
-    for (int blockidx = 0; blockidx < cfg->all_blocks.len; blockidx++) {
-        CfBlock *block = cfg->all_blocks.ptr[blockidx];
-        if (block == &cfg->end_block || block->iftrue == block->iffalse)
+static void clean_jumps_where_condition_always_true_or_always_false(struct State *st)
+{
+    analyze(st);
+    bool changed = false;
+
+    for (int blockidx = 0; blockidx < st->cfg->all_blocks.len; blockidx++) {
+        CfBlock *block = st->cfg->all_blocks.ptr[blockidx];
+        if (block == &st->cfg->end_block || block->iftrue == block->iffalse)
             continue;
 
-        switch(statuses[blockidx][find_var_index(cfg, block->branchvar)]) {
+        switch(status_at_end_of_block(st, blockidx, block->branchvar)) {
         case VS_TRUE:
             // Always jump to true case.
             block->iffalse = block->iftrue;
+            changed = true;
             break;
         case VS_FALSE:
             // Always jump to false case.
             block->iftrue = block->iffalse;
+            changed = true;
             break;
         default:
             break;
         }
     }
-    free_var_statuses(cfg, statuses);
+
+    if (changed)
+        invalidate_analysis(st);
 }
 
 /*
-Two blocks will end up in the same group, if there is an execution path from one block to another.
-Return value: array of groups, each group is an array of CfBlock pointers.
-All returned arrays are NULL terminated.
-
-This is not very efficient code, but it's only used for unreachable blocks.
-In a typical program, I don't expect to have many unreachable blocks.
+Constant propagation: find variables that always have the same value, and
+blocks that can never run because a condition is always true or always false.
+
+Unlike the variable statuses above, this doesn't track what happens at each
+point of the function. Each variable only gets one value, which is the result
+of combining everything that is ever assigned to it in blocks that can run.
+This is enough for the temporary variables that the compiler creates for
+each expression, because they are assigned only once.
+
+The analysis is optimistic: a block is assumed to never run until we find a
+way to get there, and a variable's value is assumed to be unknown until we
+find an assignment to it. Whenever something changes, only instructions that
+use the changed variable are looked at again, not the whole function.
 */
-static CfBlock ***group_blocks(CfBlock **blocks, int nblocks)
+struct LatticeValue {
+    enum LatticeLevel {
+        LAT_UNKNOWN = 0,  // Not assigned in any block that can run (yet).
+        LAT_CONSTANT,     // Always the same constant.
+        LAT_VARYING,      // Can be different things, or not known at compile time.
+    } level;
+    Constant constant;  // LAT_CONSTANT
+};
+
+static const struct LatticeValue varying = { .level = LAT_VARYING };
+
+static bool same_constant(const Constant *a, const Constant *b)
 {
-    CfBlock ***groups = calloc(sizeof(groups[0]), nblocks+1);  // NOLINT
+    if (a->kind != b->kind)
+        return false;
+    switch(a->kind) {
+    case CONSTANT_INTEGER:
+        return a->data.integer.width_in_bits == b->data.integer.width_in_bits
+            && a->data.integer.is_signed == b->data.integer.is_signed
+            && a->data.integer.value == b->data.integer.value;
+    case CONSTANT_BOOL:
+        return a->data.boolean == b->data.boolean;
+    case CONSTANT_NULL:
+        return true;
+    case CONSTANT_STRING:
+        return false;  // not tracked
+    }
+    assert(0);
+}
 
-    // Initially there is a separate group for each block.
-    int ngroups = nblocks;
-    for (int i = 0; i < nblocks; i++) {
-        groups[i] = calloc(sizeof(groups[i][0]), nblocks + 1); // NOLINT
-        groups[i][0] = blocks[i];
+// Combine two things that a variable can be. Returns true if dest changed.
+static bool meet_lattice_values(struct LatticeValue *dest, const struct LatticeValue *src)
+{
+    if (src->level == LAT_UNKNOWN || dest->level == LAT_VARYING)
+        return false;
+    if (dest->level == LAT_UNKNOWN) {
+        *dest = *src;
+        return true;
     }
+    if (src->level == LAT_CONSTANT && same_constant(&dest->constant, &src->constant))
+        return false;
+    *dest = varying;
+    return true;
+}
 
-    // For each block, we need to check whether that block can jump outside its
-    // group. When that does, merge the two groups together.
-    for (int block1index = 0; block1index < nblocks; block1index++) {
-        CfBlock *block1 = blocks[block1index];
-        if (block1->iffalse==NULL && block1->iftrue==NULL)
-            continue;  // the end block
+// Cut to given number of bits, then sign-extend or zero-extend back to 64 bits.
+static long long wrap_integer(unsigned long long value, int width_in_bits, bool is_signed)
+{
+    if (width_in_bits == 64)
+        return (long long)value;
+    unsigned long long mask = (1ULL << width_in_bits) - 1;
+    value &= mask;
+    if (is_signed && (value >> (width_in_bits - 1)))
+        value |= ~mask;
+    return (long long)value;
+}
 
-        for (int m = 0; m < 2; m++) {
-            CfBlock *block2 = m ? block1->iffalse : block1->iftrue;
-            assert(block2);
-
-            // Find groups of block1 and block2.
-            CfBlock ***g1 = NULL, ***g2 = NULL;
-            for (int i = 0; groups[i]; i++) {
-                for (int k = 0; groups[i][k]; k++) {
-                    if (groups[i][k] == block1) g1=&groups[i];
-                    if (groups[i][k] == block2) g2=&groups[i];
+static struct LatticeValue integer_value(const Type *t, unsigned long long value)
+{
+    bool is_signed = (t->kind == TYPE_SIGNED_INTEGER);
+    Constant c = { CONSTANT_INTEGER, {.integer = {
+        .width_in_bits = t->data.width_in_bits,
+        .is_signed = is_signed,
+        .value = wrap_integer(value, t->data.width_in_bits, is_signed),
+    }}};
+    return (struct LatticeValue){ LAT_CONSTANT, c };
+}
+
+static struct LatticeValue bool_value(bool b)
+{
+    return (struct LatticeValue){ LAT_CONSTANT, { CONSTANT_BOOL, {.boolean = b} } };
+}
+
+// What the destination variable of an instruction will be, given what we know about the operands.
+static struct LatticeValue evaluate_instruction(const CfInstruction *ins, const struct LatticeValue *operands)
+{
+    for (int i = 0; i < ins->noperands; i++) {
+        if (operands[i].level == LAT_VARYING)
+            return varying;
+    }
+    for (int i = 0; i < ins->noperands; i++) {
+        if (operands[i].level == LAT_UNKNOWN)
+            return (struct LatticeValue){ LAT_UNKNOWN };
+    }
+
+    const Constant *a = ins->noperands >= 1 ? &operands[0].constant : NULL;
+    const Constant *b = ins->noperands >= 2 ? &operands[1].constant : NULL;
+
+    switch(ins->kind) {
+    case CF_CONSTANT:
+        if (ins->data.constant.kind == CONSTANT_STRING)
+            return varying;
+        // Literals like 0xFFFFFFFF don't fit in int. Wrap them like computed values.
+        if (ins->data.constant.kind == CONSTANT_INTEGER)
+            return integer_value(type_of_constant(&ins->data.constant), ins->data.constant.data.integer.value);
+        return (struct LatticeValue){ LAT_CONSTANT, ins->data.constant };
+    case CF_VARCPY:
+        return operands[0];
+    case CF_BOOL_NEGATE:
+        return bool_value(!a->data.boolean);
+    case CF_BOOL_AND:
+        return bool_value(a->data.boolean && b->data.boolean);
+    case CF_BOOL_OR:
+        return bool_value(a->data.boolean || b->data.boolean);
+    case CF_PTR_CAST:
+        // Keep track of NULL, so that comparing it with NULL can be evaluated.
+        return operands[0];
+    case CF_PTR_EQ:
+        if (a->kind == CONSTANT_NULL && b->kind == CONSTANT_NULL)
+            return bool_value(true);
+        return varying;
+    case CF_INT_EQ:
+        return bool_value(same_constant(a, b));
+    case CF_INT_LT:
+        {
+            // Must match codegen, which always does a signed comparison.
+            int w = ins->operands[0]->type->data.width_in_bits;
+            return bool_value(wrap_integer(a->data.integer.value, w, true) < wrap_integer(b->data.integer.value, w, true));
+        }
+    case CF_INT_CAST:
+        return integer_value(ins->destvar->type, a->data.integer.value);
+    case CF_INT_ADD:
+        return integer_value(ins->destvar->type, (unsigned long long)a->data.integer.value + (unsigned long long)b->data.integer.value);
+    case CF_INT_SUB:
+        return integer_value(ins->destvar->type, (unsigned long long)a->data.integer.value - (unsigned long long)b->data.integer.value);
+    case CF_INT_MUL:
+        return integer_value(ins->destvar->type, (unsigned long long)a->data.integer.value * (unsigned long long)b->data.integer.value);
+    case CF_INT_SDIV:
+        {
+            // Division by zero and overflow are left to happen at runtime.
+            long long min = wrap_integer(1ULL << (a->data.integer.width_in_bits - 1), a->data.integer.width_in_bits, true);
+            if (b->data.integer.value == 0 || (a->data.integer.value == min && b->data.integer.value == -1))
+                return varying;
+            return integer_value(ins->destvar->type, (unsigned long long)(a->data.integer.value / b->data.integer.value));
+        }
+    case CF_INT_UDIV:
+        if (b->data.integer.value == 0)
+            return varying;
+        return integer_value(ins->destvar->type, (unsigned long long)a->data.integer.value / (unsigned long long)b->data.integer.value);
+    case CF_CALL:
+    case CF_ADDRESS_OF_VARIABLE:
+    case CF_PTR_MEMSET_TO_ZERO:
+    case CF_PTR_STORE:
+    case CF_PTR_LOAD:
+    case CF_PTR_STRUCT_FIELD:
+    case CF_PTR_ADD_INT:
+        return varying;
+    }
+    assert(0);
+}
+
+struct ConstPropState {
+    const CfGraph *cfg;
+    const struct CfgIndexes *ind;
+    struct LatticeValue *values;  // indexed by variable index
+    bool *executable;  // indexed by block index
+    List(int) blocks_to_visit;  // blocks that just became executable
+    List(int) changed_vars;  // variables whose value changed, need to look at instructions using them
+
+    /*
+    Instructions reading variable v are listed in uses[usestart[v]], ..., uses[usestart[v+1]-1].
+    Instruction i of block b is encoded as insstart[b]+i. A block that uses the variable
+    to decide where to jump is encoded as ~b (negative).
+    */
+    int *insstart;
+    int *usestart;
+    int *uses;
+};
+
+static void mark_executable(struct ConstPropState *cps, int blockidx)
+{
+    if (blockidx != -1 && !cps->executable[blockidx]) {
+        cps->executable[blockidx] = true;
+        Append(&cps->blocks_to_visit, blockidx);
+    }
+}
+
+static void const_prop_instruction(struct ConstPropState *cps, const CfInstruction *ins)
+{
+    if (!ins->destvar)
+        return;
+
+    struct LatticeValue operands[3];  // enough except for function calls, which are not evaluated
+    struct LatticeValue result;
+    if (ins->noperands > 3) {
+        result = varying;
+    } else {
+        for (int i = 0; i < ins->noperands; i++)
+            operands[i] = cps->values[cps->ind->var_indexes_by_id[ins->operands[i]->id]];
+        result = evaluate_instruction(ins, operands);
+    }
+
+    int destidx = cps->ind->var_indexes_by_id[ins->destvar->id];
+    if (meet_lattice_values(&cps->values[destidx], &result))
+        Append(&cps->changed_vars, destidx);
+}
+
+static void const_prop_jump(struct ConstPropState *cps, int blockidx)
+{
+    const CfBlock *b = cps->cfg->all_blocks.ptr[blockidx];
+    const int *succ = &cps->ind->successors[2*blockidx];
+
+    if (b != &cps->cfg->end_block && b->iftrue != b->iffalse) {
+        const struct LatticeValue *cond = &cps->values[cps->ind->var_indexes_by_id[b->branchvar->id]];
+        if (cond->level == LAT_CONSTANT) {
+            mark_executable(cps, succ[cond->constant.data.boolean ? 0 : 1]);
+            return;
+        }
+    }
+    mark_executable(cps, succ[0]);
+    mark_executable(cps, succ[1]);
+}
+
+static void compute_uses(struct ConstPropState *cps)
+{
+    const CfGraph *cfg = cps->cfg;
+    int nblocks = cfg->all_blocks.len;
+    int nvars = cfg->variables.len;
+    const int *varidx = cps->ind->var_indexes_by_id;
+
+    cps->insstart = malloc(sizeof(cps->insstart[0]) * (nblocks + 1));  // NOLINT
+    cps->usestart = calloc(sizeof(cps->usestart[0]), nvars + 1);
+    cps->insstart[0] = 0;
+    for (int b = 0; b < nblocks; b++) {
+        const CfBlock *block = cfg->all_blocks.ptr[b];
+        cps->insstart[b+1] = cps->insstart[b] + block->instructions.len;
+        for (const CfInstruction *ins = block->instructions.ptr; ins < End(block->instructions); ins++)
+            for (int i = 0; i < ins->noperands; i++)
+                cps->usestart[varidx[ins->operands[i]->id] + 1]++;
+        if (block != &cfg->end_block && block->iftrue != block->iffalse)
+            cps->usestart[varidx[block->branchvar->id] + 1]++;
+    }
+
+    for (int v = 0; v < nvars; v++)
+        cps->usestart[v+1] += cps->usestart[v];
+    cps->uses = malloc(sizeof(cps->uses[0]) * (cps->usestart[nvars] + 1));  // NOLINT
+    int *fill = malloc(sizeof(fill[0]) * (nvars + 1));  // NOLINT
+    memcpy(fill, cps->usestart, sizeof(fill[0]) * nvars);
+
+    for (int b = 0; b < nblocks; b++) {
+        const CfBlock *block = cfg->all_blocks.ptr[b];
+        for (int k = 0; k < block->instructions.len; k++) {
+            const CfInstruction *ins = &block->instructions.ptr[k];
+            for (int i = 0; i < ins->noperands; i++)
+                cps->uses[fill[varidx[ins->operands[i]->id]]++] = cps->insstart[b] + k;
+        }
+        if (block != &cfg->end_block && block->iftrue != block->iffalse)
+            cps->uses[fill[varidx[block->branchvar->id]]++] = ~b;
+    }
+    free(fill);
+}
+
+// Finds the block that contains the given instruction (see ConstPropState.insstart).
+static int block_of_instruction(const struct ConstPropState *cps, int insnum)
+{
+    int lo = 0, hi = cps->cfg->all_blocks.len;  // insstart[lo] <= insnum < insstart[hi]
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (cps->insstart[mid] <= insnum)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Returns values of variables, indexed by variable ID.
+static struct LatticeValue *propagate_constants(struct State *st)
+{
+    CfGraph *cfg = st->cfg;
+    bool owns_indexes = !st->analysis_valid;
+    struct CfgIndexes ind = owns_indexes ? compute_indexes(cfg) : st->ind;
+
+    struct ConstPropState cps = {
+        .cfg = cfg,
+        .ind = &ind,
+        .values = calloc(sizeof(cps.values[0]), cfg->variables.len + 1),
+        .executable = calloc(sizeof(cps.executable[0]), cfg->all_blocks.len),
+    };
+    compute_uses(&cps);
+
+    // Arguments and variables modified through pointers can be anything.
+    for (int i = 0; i < cfg->variables.len; i++)
+        if (cfg->variables.ptr[i]->is_argument)
+            cps.values[i] = varying;
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++)
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++)
+            if (ins->kind == CF_ADDRESS_OF_VARIABLE)
+                cps.values[ind.var_indexes_by_id[ins->operands[0]->id]] = varying;
+
+    mark_executable(&cps, 0);
+    while (cps.blocks_to_visit.len || cps.changed_vars.len) {
+        if (cps.blocks_to_visit.len) {
+            int blockidx = Pop(&cps.blocks_to_visit);
+            const CfBlock *b = cfg->all_blocks.ptr[blockidx];
+            for (const CfInstruction *ins = b->instructions.ptr; ins < End(b->instructions); ins++)
+                const_prop_instruction(&cps, ins);
+            const_prop_jump(&cps, blockidx);
+        } else {
+            int v = Pop(&cps.changed_vars);
+            for (int i = cps.usestart[v]; i < cps.usestart[v+1]; i++) {
+                int use = cps.uses[i];
+                if (use < 0) {
+                    if (cps.executable[~use])
+                        const_prop_jump(&cps, ~use);
+                } else {
+                    int blockidx = block_of_instruction(&cps, use);
+                    if (cps.executable[blockidx]) {
+                        const CfBlock *b = cfg->all_blocks.ptr[blockidx];
+                        const_prop_instruction(&cps, &b->instructions.ptr[use - cps.insstart[blockidx]]);
+                    }
                 }
             }
+        }
+    }
+
+    // Jumps whose condition is always the same go to only one place.
+    bool changed = false;
+    for (int blockidx = 0; blockidx < cfg->all_blocks.len; blockidx++) {
+        CfBlock *block = cfg->all_blocks.ptr[blockidx];
+        if (!cps.executable[blockidx] || block == &cfg->end_block || block->iftrue == block->iffalse)
+            continue;
+        const struct LatticeValue *cond = &cps.values[ind.var_indexes_by_id[block->branchvar->id]];
+        if (cond->level == LAT_CONSTANT) {
+            if (cond->constant.data.boolean)
+                block->iffalse = block->iftrue;
+            else
+                block->iftrue = block->iffalse;
+            changed = true;
+        }
+    }
+
+    int maxid = -1;
+    for (int i = 0; i < cfg->variables.len; i++)
+        maxid = max(maxid, cfg->variables.ptr[i]->id);
+    struct LatticeValue *values_by_id = calloc(sizeof(values_by_id[0]), maxid + 2);
+    for (int i = 0; i < cfg->variables.len; i++)
+        values_by_id[cfg->variables.ptr[i]->id] = cps.values[i];
+
+    free(cps.values);
+    free(cps.executable);
+    free(cps.blocks_to_visit.ptr);
+    free(cps.changed_vars.ptr);
+    free(cps.insstart);
+    free(cps.usestart);
+    free(cps.uses);
+    if (owns_indexes)
+        free_indexes(&ind);
+    if (changed)
+        invalidate_analysis(st);
+    return values_by_id;
+}
+
+/*
+Replace instructions that always produce the same value with constants.
+This is done after all warnings have been shown, because it removes uses of
+variables, and a variable that may be undefined should still get a warning.
+*/
+static void fold_constants(CfGraph *cfg, const struct LatticeValue *values_by_id)
+{
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++) {
+        for (CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++) {
+            if (!ins->destvar || ins->kind == CF_CONSTANT)
+                continue;
+            const struct LatticeValue *val = &values_by_id[ins->destvar->id];
+            // Type check is needed for NULL, which is always void* in a CF_CONSTANT.
+            if (val->level == LAT_CONSTANT && type_of_constant(&val->constant) == ins->destvar->type) {
+                ins->kind = CF_CONSTANT;
+                ins->data.constant = val->constant;
+                ins->operands = NULL;
+                ins->noperands = 0;
+            }
+        }
+    }
+}
+
+/*
+Copy propagation. The code that build_cfg.c generates for "y = x + 1" is:
 
-            if (g1 && g2 && *g1!=*g2) {
-                // Append all blocks from group 2 to group 1.
-                CfBlock **dest = *g1, **src = *g2;
-                while (*dest) dest++;
-                while ((*dest++ = *src++)) ;
+    $1 = x
+    $2 = 1
+    $3 = iadd $1, $2
+    y = $3
 
-                // Delete group 2.
-                free(*g2);
-                *g2 = groups[--ngroups];
-                groups[ngroups] = NULL;
+Every variable is a stack slot in the generated code, so each copy is a load
+and a store. Here we turn the above into:
+
+    $2 = 1
+    y = iadd x, $2
+
+This only looks at one block at a time, because temporary variables are almost
+always used in the same block where they are set. Variables whose address is
+taken are left alone, because they can change without an instruction that
+sets them.
+*/
+static void count_reads(const CfGraph *cfg, const int *varidx, int *nreads)
+{
+    memset(nreads, 0, sizeof(nreads[0]) * cfg->variables.len);
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++) {
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++)
+            for (int i = 0; i < ins->noperands; i++)
+                nreads[varidx[ins->operands[i]->id]]++;
+        if (*b != &cfg->end_block && (*b)->iftrue != (*b)->iffalse)
+            nreads[varidx[(*b)->branchvar->id]]++;
+    }
+}
+
+// Returns true if the instruction should be deleted.
+static bool coalesce_copy(const CfInstruction *ins, CfInstruction *prev, const int *varidx, const bool *address_taken, const int *nreads)
+{
+    // "$3 = iadd $1, $2" followed by "y = $3" becomes "y = iadd $1, $2"
+    if (ins->kind != CF_VARCPY || !prev)
+        return false;
+    const Variable *temp = ins->operands[0];
+    if (temp->name || prev->destvar != temp || nreads[varidx[temp->id]] != 1 || address_taken[varidx[temp->id]] || address_taken[varidx[ins->destvar->id]])
+        return false;
+    prev->destvar = ins->destvar;
+    return true;
+}
+
+static void propagate_copies(CfGraph *cfg)
+{
+    int nvars = cfg->variables.len;
+    int *varidx = map_var_ids_to_indexes(cfg);
+    int *nreads = malloc(sizeof(nreads[0]) * (nvars + 1));  // NOLINT
+
+    bool *address_taken = calloc(sizeof(address_taken[0]), nvars + 1);
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++)
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++)
+            if (ins->kind == CF_ADDRESS_OF_VARIABLE)
+                address_taken[varidx[ins->operands[0]->id]] = true;
+
+    count_reads(cfg, varidx, nreads);
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++) {
+        CfInstruction *dst = (*b)->instructions.ptr;
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++) {
+            if (!coalesce_copy(ins, dst > (*b)->instructions.ptr ? &dst[-1] : NULL, varidx, address_taken, nreads))
+                *dst++ = *ins;
+        }
+        (*b)->instructions.len = dst - (*b)->instructions.ptr;
+    }
+
+    /*
+    Replace uses of a copy with the original. If copy_block[v] is the current
+    block, then v was set to copy_of[v] in the current block. That is still
+    true if copy_of[v] hasn't been set since, i.e. its assign_count is still
+    copy_assign_count[v].
+    */
+    const Variable **copy_of = malloc(sizeof(copy_of[0]) * (nvars + 1));  // NOLINT
+    int *copy_assign_count = malloc(sizeof(copy_assign_count[0]) * (nvars + 1));  // NOLINT
+    int *copy_block = malloc(sizeof(copy_block[0]) * (nvars + 1));  // NOLINT
+    int *assign_count = calloc(sizeof(assign_count[0]), nvars + 1);
+    for (int i = 0; i < nvars; i++)
+        copy_block[i] = -1;
+
+    for (int blockidx = 0; blockidx < cfg->all_blocks.len; blockidx++) {
+        CfBlock *b = cfg->all_blocks.ptr[blockidx];
+        for (CfInstruction *ins = b->instructions.ptr; ins < End(b->instructions); ins++) {
+            for (int i = 0; i < ins->noperands; i++) {
+                int v = varidx[ins->operands[i]->id];
+                if (copy_block[v] == blockidx && assign_count[varidx[copy_of[v]->id]] == copy_assign_count[v])
+                    ins->operands[i] = copy_of[v];
             }
+
+            if (!ins->destvar)
+                continue;
+            int dest = varidx[ins->destvar->id];
+            assign_count[dest]++;
+            copy_block[dest] = -1;
+            if (ins->kind == CF_VARCPY && ins->operands[0] != ins->destvar
+                && !address_taken[dest] && !address_taken[varidx[ins->operands[0]->id]])
+            {
+                copy_of[dest] = ins->operands[0];
+                copy_assign_count[dest] = assign_count[varidx[ins->operands[0]->id]];
+                copy_block[dest] = blockidx;
+            }
+        }
+    }
+
+    // Delete copies to temporary variables that are no longer used, such as "$1 = x".
+    count_reads(cfg, varidx, nreads);
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++) {
+        CfInstruction *dst = (*b)->instructions.ptr;
+        for (const CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++) {
+            if (!(ins->kind == CF_VARCPY && !ins->destvar->name && nreads[varidx[ins->destvar->id]] == 0))
+                *dst++ = *ins;
+        }
+        (*b)->instructions.len = dst - (*b)->instructions.ptr;
+    }
+
+    free(varidx);
+    free(nreads);
+    free(address_taken);
+    free(copy_of);
+    free(copy_assign_count);
+    free(copy_block);
+    free(assign_count);
+}
+
+// Union-find: each group of blocks is a tree, and the root of the tree represents the group.
+static int find_group_root(int *parents, int i)
+{
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];  // path halving, makes later searches faster
+        i = parents[i];
+    }
+    return i;
+}
+
+/*
+Two blocks will end up in the same group, if there is an execution path from one block to another.
+Return value: array of groups, each group is an array of indexes into unreachable_blocks.
+All returned arrays are terminated with -1.
+
+The groups are returned in the same order as they were before union-find was
+used: initially there is a group for each block, and when two groups are
+merged, the last group moves to the place of the group that was merged into
+another group. The order affects which warning is shown when two groups
+start on the same line.
+*/
+static int **group_blocks(const struct CfgIndexes *ind, const int *unreachable_blocks, int n_unreachable_blocks, int nblocks)
+{
+    int n = n_unreachable_blocks;
+
+    // Which unreachable block is block i of the control flow graph? -1 if not unreachable.
+    int *position = malloc(sizeof(position[0]) * nblocks);  // NOLINT
+    for (int i = 0; i < nblocks; i++)
+        position[i] = -1;
+    for (int i = 0; i < n; i++)
+        position[unreachable_blocks[i]] = i;
+
+    int *parents = malloc(sizeof(parents[0]) * (n + 1));  // NOLINT
+    int *slot_of_root = malloc(sizeof(slot_of_root[0]) * (n + 1));  // NOLINT
+    int *root_in_slot = malloc(sizeof(root_in_slot[0]) * (n + 1));  // NOLINT
+
+    // Initially there is a separate group for each block.
+    int ngroups = n;
+    for (int i = 0; i < n; i++)
+        parents[i] = slot_of_root[i] = root_in_slot[i] = i;
+
+    // For each block, we need to check whether that block can jump outside its
+    // group. When that does, merge the two groups together.
+    for (int block1 = 0; block1 < n; block1++) {
+        for (int m = 0; m < 2; m++) {
+            int target = ind->successors[2*unreachable_blocks[block1] + (m ? 1 : 0)];
+            if (target == -1 || position[target] == -1)
+                continue;  // end block, or jump to a block that is not in any group
+            int block2 = position[target];
+
+            int root1 = find_group_root(parents, block1);
+            int root2 = find_group_root(parents, block2);
+            if (root1 == root2)
+                continue;
+
+            // Merge group 2 into group 1.
+            int slot2 = slot_of_root[root2];
+            parents[root2] = root1;
+
+            // Delete group 2, moving the last group to its place.
+            int last = root_in_slot[--ngroups];
+            root_in_slot[slot2] = last;
+            slot_of_root[last] = slot2;
         }
     }
 
+    // Collect the blocks of each group.
+    int *group_sizes = calloc(sizeof(group_sizes[0]), ngroups + 1);
+    for (int i = 0; i < n; i++)
+        group_sizes[slot_of_root[find_group_root(parents, i)]]++;
+
+    int **groups = calloc(sizeof(groups[0]), ngroups + 1);  // NOLINT
+    for (int g = 0; g < ngroups; g++) {
+        groups[g] = malloc(sizeof(groups[g][0]) * (group_sizes[g] + 1));  // NOLINT
+        group_sizes[g] = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        int g = slot_of_root[find_group_root(parents, i)];
+        groups[g][group_sizes[g]++] = i;
+    }
+    for (int g = 0; g < ngroups; g++)
+        groups[g][group_sizes[g]] = -1;
+
+    free(position);
+    free(parents);
+    free(slot_of_root);
+    free(root_in_slot);
+    free(group_sizes);
     return groups;
 }
 
-static void show_unreachable_warnings(CfBlock **unreachable_blocks, int n_unreachable_blocks)
+static void show_unreachable_warnings(const CfGraph *cfg, const struct CfgIndexes *ind, const int *unreachable_blocks, int n_unreachable_blocks)
 {
     // Show a warning in the beginning of each group of blocks.
     // Can't show a warning for each block, that would be too noisy.
-    CfBlock ***groups = group_blocks(unreachable_blocks, n_unreachable_blocks);
+    int **groups = group_blocks(ind, unreachable_blocks, n_unreachable_blocks, cfg->all_blocks.len);
 
     // Prevent showing two errors on the same line, even if from different groups
     int prev_lineno = -1;
 
     for (int groupidx = 0; groups[groupidx]; groupidx++) {
         Location first_location = { .lineno = INT_MAX };
-        for (int blockidx = 0; groups[groupidx][blockidx]; blockidx++) {
-            CfBlock *block = groups[groupidx][blockidx];
+        for (int i = 0; groups[groupidx][i] != -1; i++) {
+            const CfBlock *block = cfg->all_blocks.ptr[unreachable_blocks[groups[groupidx][i]]];
             for (const CfInstruction *ins = block->instructions.ptr; ins < End(block->instructions); ins++)
                 if (!ins->hide_unreachable_warning && ins->location.lineno < first_location.lineno)
                     first_location = ins->location;
@@ -381,87 +1111,378 @@ static void show_unreachable_warnings(CfBlock **unreachable_blocks, int n_unreac
     free(groups);
 }
 
-static void remove_given_blocks(CfGraph *cfg, CfBlock **blocks_to_remove, int n_blocks_to_remove)
+static void remove_given_blocks(CfGraph *cfg, const bool *shouldgo)
 {
-    for (int i = cfg->all_blocks.len - 1; i >= 0; i--) {
-        bool shouldgo = false;
-        for (CfBlock **b = blocks_to_remove; b < &blocks_to_remove[n_blocks_to_remove]; b++) {
-            if(*b==cfg->all_blocks.ptr[i]){
-                shouldgo=true;
-                break;
-            }
+    // Going backwards, so that the blocks moved from the end have already been checked.
+    for (int i = cfg->all_blocks.len - 1; i >= 0; i--)
+        if (shouldgo[i])
+            cfg->all_blocks.ptr[i] = Pop(&cfg->all_blocks);
+}
+
+static void remove_unreachable_blocks(struct State *st)
+{
+    // Blocks that the depth-first search didn't find are unreachable.
+    CfGraph *cfg = st->cfg;
+    bool owns_indexes = !st->analysis_valid;
+    struct CfgIndexes ind = owns_indexes ? compute_indexes(cfg) : st->ind;
+
+    bool *shouldgo = calloc(sizeof(shouldgo[0]), cfg->all_blocks.len);
+    List(int) unreachable_blocks = {0};
+    for (int i = 0; i < cfg->all_blocks.len; i++) {
+        if (!ind.reachable[i] && cfg->all_blocks.ptr[i] != &cfg->end_block) {
+            shouldgo[i] = true;
+            Append(&unreachable_blocks, i);
+        }
+    }
+
+    show_unreachable_warnings(cfg, &ind, unreachable_blocks.ptr, unreachable_blocks.len);
+    if (owns_indexes)
+        free_indexes(&ind);
+
+    /*
+    Removing blocks changes their indexes, and the order in which blocks are
+    analyzed depends on indexes (see determine_var_statuses()), so the analysis
+    has to be redone to get exactly the same results as analyzing the new graph.
+    */
+    if (unreachable_blocks.len != 0) {
+        remove_given_blocks(cfg, shouldgo);
+        invalidate_analysis(st);
+    }
+    free(unreachable_blocks.ptr);
+    free(shouldgo);
+}
+
+/*
+The code that build_cfg.c generates for "result = a and b" is:
+
+    block 1:
+        (evaluate a)
+        if a, jump to block 2, otherwise block 3
+    block 2:
+        (evaluate b)
+        result = b
+        jump to block 4
+    block 3:
+        result = False
+        jump to block 4
+
+If evaluating b doesn't have side effects and can't crash, we can evaluate it
+at the end of block 1 and then do "result = a band b" without jumping. Only
+the jumps are removed, so "band" must still give False when a is False, even
+if b is garbage. The code for "or" is similar.
+
+This is done after all warnings have been shown. For example, in
+"found and value > 0" the value may be undefined when found is False.
+*/
+static bool can_always_run(const CfInstruction *ins)
+{
+    switch(ins->kind) {
+    case CF_CONSTANT:
+    case CF_ADDRESS_OF_VARIABLE:
+    case CF_PTR_EQ:
+    case CF_PTR_STRUCT_FIELD:
+    case CF_PTR_CAST:
+    case CF_PTR_ADD_INT:
+    case CF_INT_ADD:
+    case CF_INT_SUB:
+    case CF_INT_MUL:
+    case CF_INT_EQ:
+    case CF_INT_LT:
+    case CF_INT_CAST:
+    case CF_BOOL_NEGATE:
+    case CF_BOOL_AND:
+    case CF_BOOL_OR:
+    case CF_VARCPY:
+        return true;
+    case CF_CALL:
+    case CF_PTR_MEMSET_TO_ZERO:
+    case CF_PTR_STORE:
+    case CF_PTR_LOAD:
+    case CF_INT_SDIV:  // division by zero
+    case CF_INT_UDIV:
+        return false;
+    }
+    assert(0);
+}
+
+// Returns the variable set to the given constant, if that is all the block does before jumping.
+static const Variable *sets_bool_constant(const CfBlock *b, bool value)
+{
+    if (b->instructions.len != 1)
+        return NULL;
+    const CfInstruction *ins = &b->instructions.ptr[0];
+    if (ins->kind != CF_CONSTANT || ins->data.constant.kind != CONSTANT_BOOL || ins->data.constant.data.boolean != value)
+        return NULL;
+    return ins->destvar;
+}
+
+// Returns true if something was done.
+static bool remove_jumps_of_and_or(CfGraph *cfg)
+{
+    int nblocks = cfg->all_blocks.len;
+    int maxid = -1;
+    for (int i = 0; i < nblocks; i++)
+        maxid = max(maxid, cfg->all_blocks.ptr[i]->id);
+    int *block_indexes_by_id = malloc(sizeof(block_indexes_by_id[0]) * (maxid + 1));  // NOLINT
+    for (int i = 0; i < nblocks; i++)
+        block_indexes_by_id[cfg->all_blocks.ptr[i]->id] = i;
+
+    int *npreds = calloc(sizeof(npreds[0]), nblocks + 1);
+    for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++) {
+        if (*b != &cfg->end_block) {
+            npreds[block_indexes_by_id[(*b)->iftrue->id]]++;
+            if ((*b)->iffalse != (*b)->iftrue)
+                npreds[block_indexes_by_id[(*b)->iffalse->id]]++;
         }
-        if(shouldgo)
+    }
+
+    Liveness *lv = compute_liveness(cfg);
+    bool *shouldgo = calloc(sizeof(shouldgo[0]), nblocks + 1);
+    bool changed = false;
+
+    for (int i = 0; i < nblocks; i++) {
+        CfBlock *b = cfg->all_blocks.ptr[i];
+        if (shouldgo[i] || b == &cfg->end_block || b->iftrue == b->iffalse)
+            continue;
+        CfBlock *t = b->iftrue, *f = b->iffalse;
+        if (t == &cfg->end_block || f == &cfg->end_block
+            || npreds[block_indexes_by_id[t->id]] != 1 || npreds[block_indexes_by_id[f->id]] != 1
+            || t->iftrue != t->iffalse || f->iftrue != f->iffalse || t->iftrue != f->iftrue)
         {
-            free_control_flow_graph_block(cfg, cfg->all_blocks.ptr[i]);
-            cfg->all_blocks.ptr[i]=Pop(&cfg->all_blocks);
+            continue;
+        }
+        CfBlock *done = t->iftrue;
+        if (done == b || done == t || done == f)
+            continue;
+
+        const CfBlock *rhsblock;
+        enum CfInstructionKind kind;
+        const Variable *result;
+        if ((result = sets_bool_constant(f, false))) {
+            rhsblock = t;
+            kind = CF_BOOL_AND;
+        } else if ((result = sets_bool_constant(t, true))) {
+            rhsblock = f;
+            kind = CF_BOOL_OR;
+        } else {
+            continue;
+        }
+
+        // The last instruction sets the result. Other variables it sets must not be needed later.
+        int n = rhsblock->instructions.len;
+        if (n == 0 || rhsblock->instructions.ptr[n-1].destvar != result)
+            continue;
+        bool ok = true;
+        for (const CfInstruction *ins = rhsblock->instructions.ptr; ins < End(rhsblock->instructions); ins++) {
+            if (!can_always_run(ins) || ins->destvar == b->branchvar)
+                ok = false;
+            else if (ins != &End(rhsblock->instructions)[-1] && ins->destvar
+                    && (ins->destvar == result || is_live_at_start_of_block(lv, done, ins->destvar)))
+                ok = false;
         }
+        if (!ok)
+            continue;
+
+        CfInstruction *instructions = arena_alloc(cfg->arena, sizeof(instructions[0]) * (b->instructions.len + n + 1));
+        if (b->instructions.len != 0)
+            memcpy(instructions, b->instructions.ptr, sizeof(instructions[0]) * b->instructions.len);
+        memcpy(&instructions[b->instructions.len], rhsblock->instructions.ptr, sizeof(instructions[0]) * n);
+
+        const Variable **operands = arena_alloc(cfg->arena, 2 * sizeof(operands[0]));
+        operands[0] = b->branchvar;
+        operands[1] = result;
+        instructions[b->instructions.len + n] = (CfInstruction){
+            .location = rhsblock->instructions.ptr[n-1].location,
+            .kind = kind,
+            .operands = operands,
+            .noperands = 2,
+            .destvar = result,
+        };
+
+        b->instructions.ptr = instructions;
+        b->instructions.len = b->instructions.alloc = b->instructions.len + n + 1;
+        b->branchvar = NULL;
+        b->iftrue = b->iffalse = done;
+        shouldgo[block_indexes_by_id[t->id]] = true;
+        shouldgo[block_indexes_by_id[f->id]] = true;
+        npreds[block_indexes_by_id[done->id]]--;
+        changed = true;
     }
+
+    remove_given_blocks(cfg, shouldgo);
+    free_liveness(lv);
+    free(shouldgo);
+    free(npreds);
+    free(block_indexes_by_id);
+    return changed;
 }
 
-static void remove_unreachable_blocks(CfGraph *cfg)
+static bool is_empty_jump(const CfGraph *cfg, const CfBlock *b)
 {
-    bool *reachable = calloc(sizeof(reachable[0]), cfg->all_blocks.len);
-    List(int) todo = {0};
-    Append(&todo, 0);  // start block
+    return b != &cfg->start_block
+        && b != &cfg->end_block
+        && b->instructions.len == 0
+        && b->iftrue == b->iffalse
+        && b->iftrue != b;
+}
 
-    while (todo.len != 0) {
-        int i = Pop(&todo);
-        if (reachable[i])
+// Where we end up by going through empty blocks. Returns b itself for an infinite loop of empty blocks.
+static CfBlock *skip_empty_blocks(const CfGraph *cfg, CfBlock *b)
+{
+    CfBlock *result = b;
+    for (int i = 0; is_empty_jump(cfg, result); i++) {
+        if (i == cfg->all_blocks.len)
+            return b;
+        result = result->iftrue;
+    }
+    return result;
+}
+
+/*
+build_cfg.c creates many blocks that only jump to the next block. Here we:
+- make jumps to empty blocks go directly to where the empty block would jump
+- merge a block into the block before it, if it's the only way to get there
+- put the remaining blocks back to their original order and renumber them.
+
+This is done after all warnings have been shown, because the warnings about
+undefined variables are shown in the order of the blocks.
+*/
+static void merge_blocks(CfGraph *cfg)
+{
+    int nblocks = cfg->all_blocks.len;
+    bool *shouldgo = calloc(sizeof(shouldgo[0]), nblocks + 1);
+
+    for (int i = 0; i < nblocks; i++) {
+        CfBlock *b = cfg->all_blocks.ptr[i];
+        if (b == &cfg->end_block)
+            continue;
+        b->iftrue = skip_empty_blocks(cfg, b->iftrue);
+        b->iffalse = skip_empty_blocks(cfg, b->iffalse);
+        if (b->iftrue == b->iffalse)
+            b->branchvar = NULL;
+    }
+    // Nothing jumps to the skipped blocks anymore.
+    for (int i = 0; i < nblocks; i++)
+        if (is_empty_jump(cfg, cfg->all_blocks.ptr[i]) && skip_empty_blocks(cfg, cfg->all_blocks.ptr[i]) != cfg->all_blocks.ptr[i])
+            shouldgo[i] = true;
+
+    int maxid = -1;
+    for (int i = 0; i < nblocks; i++)
+        maxid = max(maxid, cfg->all_blocks.ptr[i]->id);
+    int *block_indexes_by_id = malloc(sizeof(block_indexes_by_id[0]) * (maxid + 1));  // NOLINT
+    for (int i = 0; i < nblocks; i++)
+        block_indexes_by_id[cfg->all_blocks.ptr[i]->id] = i;
+
+    int *npreds = calloc(sizeof(npreds[0]), nblocks + 1);
+    for (int i = 0; i < nblocks; i++) {
+        const CfBlock *b = cfg->all_blocks.ptr[i];
+        if (!shouldgo[i] && b != &cfg->end_block) {
+            npreds[block_indexes_by_id[b->iftrue->id]]++;
+            if (b->iffalse != b->iftrue)
+                npreds[block_indexes_by_id[b->iffalse->id]]++;
+        }
+    }
+
+    // A block can be merged into the previous block, if the previous block always jumps to it and nothing else does.
+    bool *mergeable = calloc(sizeof(mergeable[0]), nblocks + 1);
+    for (int i = 0; i < nblocks; i++) {
+        const CfBlock *b = cfg->all_blocks.ptr[i];
+        if (!shouldgo[i] && b != &cfg->end_block && b->iftrue == b->iffalse && b->iftrue != b) {
+            int next = block_indexes_by_id[b->iftrue->id];
+            if (npreds[next] == 1 && b->iftrue != &cfg->end_block)
+                mergeable[next] = true;
+        }
+    }
+
+    for (int i = 0; i < nblocks; i++) {
+        CfBlock *first = cfg->all_blocks.ptr[i];
+        if (shouldgo[i] || mergeable[i])
             continue;
-        reachable[i] = true;
 
-        if (cfg->all_blocks.ptr[i] != &cfg->end_block) {
-            Append(&todo, find_block_index(cfg, cfg->all_blocks.ptr[i]->iftrue));
-            Append(&todo, find_block_index(cfg, cfg->all_blocks.ptr[i]->iffalse));
+        // Each mergeable block has only one predecessor, so this can't go around in a loop.
+        int ninstructions = 0;
+        CfBlock *last = first;
+        while (true) {
+            ninstructions += last->instructions.len;
+            if (last == &cfg->end_block || last->iftrue != last->iffalse || !mergeable[block_indexes_by_id[last->iftrue->id]])
+                break;
+            last = last->iftrue;
         }
+        if (last == first)
+            continue;
+
+        CfInstruction *instructions = arena_alloc(cfg->arena, sizeof(instructions[0]) * (ninstructions + 1));
+        int n = 0;
+        for (CfBlock *b = first; ; b = b->iftrue) {
+            if (b->instructions.len != 0)
+                memcpy(&instructions[n], b->instructions.ptr, sizeof(instructions[0]) * b->instructions.len);
+            n += b->instructions.len;
+            if (b != first)
+                shouldgo[block_indexes_by_id[b->id]] = true;
+            if (b == last)
+                break;
+        }
+        assert(n == ninstructions);
+
+        first->instructions.ptr = instructions;
+        first->instructions.len = first->instructions.alloc = n;
+        first->branchvar = last->branchvar;
+        first->iftrue = last->iftrue;
+        first->iffalse = last->iffalse;
     }
-    free(todo.ptr);
 
-    List(CfBlock *) blocks_to_remove = {0};
-    for (int i = 0; i < cfg->all_blocks.len; i++)
-        if (!reachable[i] && cfg->all_blocks.ptr[i] != &cfg->end_block)
-            Append(&blocks_to_remove, cfg->all_blocks.ptr[i]);
-    free(reachable);
+    int nkept = 0;
+    for (int i = 0; i < nblocks; i++) {
+        if (!shouldgo[i]) {
+            cfg->all_blocks.ptr[nkept] = cfg->all_blocks.ptr[i];
+            cfg->all_blocks.ptr[nkept]->id = nkept;
+            nkept++;
+        }
+    }
+    cfg->all_blocks.len = nkept;
 
-    show_unreachable_warnings(blocks_to_remove.ptr, blocks_to_remove.len);
-    remove_given_blocks(cfg, blocks_to_remove.ptr, blocks_to_remove.len);
-    free(blocks_to_remove.ptr);
+    free(shouldgo);
+    free(block_indexes_by_id);
+    free(npreds);
+    free(mergeable);
 }
 
 static void remove_unused_variables(CfGraph *cfg)
 {
     char *used = calloc(1, cfg->variables.len);
+    int *var_indexes_by_id = map_var_ids_to_indexes(cfg);
 
     for (CfBlock **b = cfg->all_blocks.ptr; b < End(cfg->all_blocks); b++) {
         for (CfInstruction *ins = (*b)->instructions.ptr; ins < End((*b)->instructions); ins++) {
             if (ins->destvar)
-                used[find_var_index(cfg, ins->destvar)] = true;
+                used[var_indexes_by_id[ins->destvar->id]] = true;
             for (int i = 0; i < ins->noperands; i++)
-                used[find_var_index(cfg, ins->operands[i])] = true;
+                used[var_indexes_by_id[ins->operands[i]->id]] = true;
         }
     }
 
     for (int i = cfg->variables.len - 1; i>=0; i--) {
         if (!used[i] && !cfg->variables.ptr[i]->is_argument) {
-            free(cfg->variables.ptr[i]);
             cfg->variables.ptr[i] = Pop(&cfg->variables);
         }
     }
 
     free(used);
+    free(var_indexes_by_id);
 }
 
-static void warn_about_undefined_variables(CfGraph *cfg)
+static void warn_about_undefined_variables(struct State *st)
 {
-    enum VarStatus **statuses = determine_var_statuses(cfg);
+    analyze(st);
+    const struct VarStatuses *vs = &st->vs;
+    const struct CfgIndexes *ind = &st->ind;
 
-    for (int blockidx = 0; blockidx < cfg->all_blocks.len; blockidx++) {
-        const CfBlock *b = cfg->all_blocks.ptr[blockidx];
-        enum VarStatus *status = statuses[blockidx];
+    for (int blockidx = 0; blockidx < st->cfg->all_blocks.len; blockidx++) {
+        const CfBlock *b = st->cfg->all_blocks.ptr[blockidx];
+        StatusWord *status = statuses_of_block(vs, blockidx);
         for (CfInstruction *ins = b->instructions.ptr; ins < End(b->instructions); ins++) {
             for (int i = 0; i < ins->noperands; i++) {
-                switch(status[find_var_index(cfg, ins->operands[i])]) {
+                switch(get_status(vs, status, ind->var_indexes_by_id[ins->operands[i]->id])) {
                 case VS_UNVISITED:
                     assert(0);
                 case VS_TRUE:
@@ -475,40 +1496,38 @@ static void warn_about_undefined_variables(CfGraph *cfg)
                     They can be undefined if a user's undefined variable is copied to them.
                     But in that case we get a warning from the user's variable anyway.
                     */
-                    if (ins->operands[i]->name[0])
+                    if (ins->operands[i]->name)
                         show_warning(ins->location, "the value of '%s' may be undefined", ins->operands[i]->name);
                     break;
                 case VS_UNDEFINED:
-                    if (ins->operands[i]->name[0])
+                    if (ins->operands[i]->name)
                         show_warning(ins->location, "the value of '%s' is undefined", ins->operands[i]->name);
                     break;
                 }
             }
-            update_statuses_with_instruction(cfg, status, ins);
+            update_statuses_with_instruction(vs, ind, status, ins);
         }
     }
-
-    free_var_statuses(cfg, statuses);
 }
 
-static void error_about_missing_return(CfGraph *cfg, const Signature *sig)
+static void error_about_missing_return(struct State *st, const Signature *sig)
 {
     if (!sig->returntype)
         return;
 
-    enum VarStatus **statuses = determine_var_statuses(cfg);
-
     // When a function returns a value, it is stored in a variable named "return".
-    int varidx = -1;
-    for (int i = 0; i < cfg->variables.len; i++) {
-        if (!strcmp(cfg->variables.ptr[i]->name, "return")) {
-            varidx = i;
+    const Variable *retvar = NULL;
+    for (int i = 0; i < st->cfg->variables.len; i++) {
+        if (st->cfg->variables.ptr[i]->name == known_names.kw_return) {
+            retvar = st->cfg->variables.ptr[i];
             break;
         }
     }
-    assert(varidx != -1);
+    assert(retvar);
+
+    analyze(st);
+    enum VarStatus s = status_at_end_of_block(st, st->ind.end_block_index, retvar);
 
-    enum VarStatus s = statuses[find_block_index(cfg, &cfg->end_block)][varidx];
     if (s == VS_POSSIBLY_UNDEFINED) {
         show_warning(
             sig->returntype_location,
@@ -518,24 +1537,27 @@ static void error_about_missing_return(CfGraph *cfg, const Signature *sig)
         fail_with_error(
             sig->returntype_location,
             "function '%s' must return a value, because it is defined with '-> %s'",
-            sig->funcname, sig->returntype->name);
+            sig->funcname, type_name(sig->returntype));
     }
-
-    free_var_statuses(cfg, statuses);
 }
 
-static void simplify_cfg(CfGraph *cfg, const Signature *sig)
+void simplify_control_flow_graph(CfGraph *cfg, const Signature *sig, FunctionStats *stats)
 {
-    clean_jumps_where_condition_always_true_or_always_false(cfg);
-    remove_unreachable_blocks(cfg);
-    error_about_missing_return(cfg, sig);
+    struct State st = { .cfg = cfg, .stats = stats };
+    clean_jumps_where_condition_always_true_or_always_false(&st);
+    struct LatticeValue *values_by_id = propagate_constants(&st);
+    remove_unreachable_blocks(&st);
+    error_about_missing_return(&st, sig);
+    remove_unused_variables(cfg);
+    warn_about_undefined_variables(&st);  // must be last analysis, modifies the variable statuses
+    invalidate_analysis(&st);
+
+    fold_constants(cfg, values_by_id);
+    free(values_by_id);
+    propagate_copies(cfg);
+    merge_blocks(cfg);
+    while (remove_jumps_of_and_or(cfg))
+        merge_blocks(cfg);
+    remove_dead_instructions(cfg);
     remove_unused_variables(cfg);
-    warn_about_undefined_variables(cfg);
-}
-
-void simplify_control_flow_graphs(const CfGraphFile *cfgfile)
-{
-    for (int i = 0; i < cfgfile->nfuncs; i++)
-        if (cfgfile->graphs[i])
-            simplify_cfg(cfgfile->graphs[i], &cfgfile->signatures[i]);
 }
@@ -14,54 +14,98 @@
 
 
 struct State {
-    FILE *f;
+    const char *start;  // beginning of the source buffer
+    const char *pos;    // next byte to read
+    const char *end;    // end of the source buffer
     Location location;
-    List(char) pushback;
+    List(char) strbuf;  // reused for the contents of each string and character literal
 };
 
-static char read_byte(struct State *st) {
-    int c;
-    if (st->pushback.len != 0) {
-        c = Pop(&st->pushback);
-        goto got_char;
+/*
+Reading the whole file into memory at once is much faster than reading it one
+byte at a time with fgetc(). It also makes looking ahead cheap: unread_byte()
+simply moves the position back.
+
+The returned buffer starts with a fake newline, see tokenize_without_indent_dedent_tokens().
+*/
+static char *read_source_file(const char *filename, size_t *len)
+{
+    Location location = { .filename = filename };
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        fail_with_error(location, "cannot open file: %s", strerror(errno));
+
+    // If we know the file size, we can usually read everything with one fread().
+    size_t alloc = 4096;
+    long size;
+    if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0)
+        alloc = (size_t)size + 2;  // +1 for the fake newline, +1 to notice end of file without growing
+
+    char *buf = malloc(alloc);
+    if (!buf) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    buf[0] = '\n';
+    *len = 1;
+
+    while(1) {
+        if (*len == alloc) {
+            alloc *= 2;
+            buf = realloc(buf, alloc);
+            if (!buf) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        size_t n = fread(&buf[*len], 1, alloc - *len, f);
+        *len += n;
+        if (n == 0) {
+            if (ferror(f))
+                fail_with_error(location, "cannot read file: %s", strerror(errno));
+            break;
+        }
     }
 
-    c = fgetc(st->f);
-    if (c == EOF && ferror(st->f))
-        fail_with_error(st->location, "cannot read file: %s", strerror(errno));
+    fclose(f);
+    return buf;
+}
+
+static char read_byte(struct State *st) {
+    // Use the zero byte to represent end of file.
+    if (st->pos == st->end)
+        return '\0';
+
+    char c = *st->pos++;
 
     // For Windows: \r\n in source file is treated same as \n
     if (c == '\r') {
-        c = fgetc(st->f);
-        if (c == EOF && ferror(st->f))
-            fail_with_error(st->location, "cannot read file: %s", strerror(errno));
-        if (c != '\n')
+        if (st->pos == st->end || *st->pos != '\n')
             fail_with_error(st->location, "source file contains a CR byte ('\\r') that isn't a part of a CRLF line ending");
+        c = *st->pos++;
     }
 
-    // Use the zero byte to represent end of file.
     if (c == '\0')
         fail_with_error(st->location, "source file contains a zero byte");  // TODO: test this
-    if (c == EOF) {
-        assert(!ferror(st->f));
-        return '\0';
-    }
-
-got_char:
     if (c == '\n')
         st->location.lineno++;
     return c;
 }
 
-// Can't use ungetc() because it is only guaranteed to work for one byte.
 static void unread_byte(struct State *st, char c)
 {
     if (c == '\0')
         return;
     assert(c!='\r');  // c should be from read_byte()
-    Append(&st->pushback, c);
-    if (c == '\n')
+    assert(st->pos > st->start);
+    st->pos--;
+    assert(*st->pos == c);
+    if (c == '\n') {
+        // Go back to the start of \r\n
+        if (st->pos > st->start && st->pos[-1] == '\r')
+            st->pos--;
         st->location.lineno--;
+    }
 }
 
 static bool is_identifier_or_number_byte(char c)
@@ -69,30 +113,109 @@ static bool is_identifier_or_number_byte(char c)
     return ('A'<=c && c<='Z') || ('a'<=c && c<='z') || c=='_' || ('0'<=c && c<='9');
 }
 
+/*
+The functions below find the end of a run of similar bytes, such as the rest
+of a comment or an identifier. Most of the source file goes through them, so
+they look at 16 bytes at a time with SSE2 when possible. The scalar loops are
+used for the last few bytes of the file and on CPUs without SSE2. Compile with
+-DNO_SIMD_TOKENIZER to use only the scalar loops (see benchmark.sh).
+
+These functions don't care about line numbers or CR bytes, so the callers only
+skip bytes that can't be '\r' or '\n'.
+*/
+#if defined(__SSE2__) && !defined(NO_SIMD_TOKENIZER)
+#define SIMD_TOKENIZER
+#include <emmintrin.h>
+
+// Returns a bit mask with 1 bits for bytes that are identifier or number bytes.
+static int identifier_or_number_mask(__m128i v)
+{
+    // 'A'-'Z' and 'a'-'z' both become 'a'-'z'. Bytes >= 0x80 are negative and fail the signed comparisons.
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a'-1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z'+1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0'-1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9'+1)));
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore));
+}
+#endif
+
+static const char *skip_identifier_or_number_bytes(const char *p, const char *end)
+{
+#ifdef SIMD_TOKENIZER
+    while (end - p >= 16) {
+        int mask = identifier_or_number_mask(_mm_loadu_si128((const __m128i *)p));
+        if (mask != 0xffff)
+            return p + __builtin_ctz(~mask);
+        p += 16;
+    }
+#endif
+    while (p < end && is_identifier_or_number_byte(*p))
+        p++;
+    return p;
+}
+
+static const char *skip_spaces(const char *p, const char *end)
+{
+#ifdef SIMD_TOKENIZER
+    while (end - p >= 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), _mm_set1_epi8(' ')));
+        if (mask != 0xffff)
+            return p + __builtin_ctz(~mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p == ' ')
+        p++;
+    return p;
+}
+
+// Skips bytes until one of the given bytes is found. The stop bytes can include '\0'.
+static const char *skip_until_any_of(const char *p, const char *end, const char *stopbytes, int nstopbytes)
+{
+#ifdef SIMD_TOKENIZER
+    assert(nstopbytes <= 5);
+    __m128i stops[5];
+    for (int i = 0; i < 5; i++)
+        stops[i] = _mm_set1_epi8(stopbytes[min(i, nstopbytes-1)]);  // repeat last if less than 5
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i found = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, stops[0]), _mm_cmpeq_epi8(v, stops[1])),
+            _mm_or_si128(_mm_cmpeq_epi8(v, stops[2]), _mm_or_si128(_mm_cmpeq_epi8(v, stops[3]), _mm_cmpeq_epi8(v, stops[4]))));
+        int mask = _mm_movemask_epi8(found);
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && !memchr(stopbytes, *p, nstopbytes))
+        p++;
+    return p;
+}
+
 static void read_identifier_or_number(struct State *st, char firstbyte, char (*dest)[100])
 {
     memset(*dest, 0, sizeof *dest);
-    int destlen = 0;
 
+    // The first byte has been read already, it is just before st->pos.
     assert(is_identifier_or_number_byte(firstbyte));
-    (*dest)[destlen++] = firstbyte;
+    assert(st->pos[-1] == firstbyte);
+    const char *start = &st->pos[-1];
+    const char *end = skip_identifier_or_number_bytes(st->pos, st->end);
 
-    while(1) {
-        char c = read_byte(st);
-        if (!is_identifier_or_number_byte(c)) {
-            unread_byte(st, c);
-            return;
-        }
-
-        if (destlen == sizeof *dest - 1)
-            fail_with_error(st->location, "name is too long: %.20s...", *dest);
-        (*dest)[destlen++] = c;
+    if (end - start >= (long)sizeof *dest) {
+        memcpy(*dest, start, sizeof *dest - 1);
+        fail_with_error(st->location, "name is too long: %.20s...", *dest);
     }
+    memcpy(*dest, start, end - start);
+    st->pos = end;
 }
 
 static void consume_rest_of_line(struct State *st)
 {
     while(1) {
+        st->pos = skip_until_any_of(st->pos, st->end, "\n\r\0", 3);
         char c = read_byte(st);
         if (c == '\n') {
             unread_byte(st, '\n');
@@ -109,6 +232,10 @@ static void read_indentation_as_newline_token(struct State *st, Token *t)
     t->type = TOKEN_NEWLINE;
 
     while(1) {
+        const char *p = skip_spaces(st->pos, st->end);
+        t->data.indentation_level += p - st->pos;
+        st->pos = p;
+
         char c = read_byte(st);
         if (c == ' ')
             t->data.indentation_level++;
@@ -157,30 +284,38 @@ static long long parse_integer(const char *str, Location location)
     return strtoll(digits, NULL, base);
 }
 
-static bool is_keyword(const char *s)
-{
-    const char *keywords[] = {
-        "def", "declare", "struct",
-        "return", "if", "elif", "else", "while", "for", "break", "continue",
-        "True", "False", "NULL",
-        "and", "or", "not", "as",
-        "void", "bool", "byte", "int",
-    };
-    for (const char **kw = &keywords[0]; kw < &keywords[sizeof(keywords)/sizeof(keywords[0])]; kw++)
-        if (!strcmp(*kw, s))
-            return true;
-    return false;
-}
-
-// Assumes the initial quote has been read already
-static char *read_string(struct State *st, char quote, int *len)
+// Assumes the initial quote has been read already. Result goes to st->strbuf.
+static void read_string(struct State *st, char quote)
 {
     assert(quote == '\'' || quote == '"');
-    List(char) result = {0};
+    st->strbuf.len = 0;
+
+    // Bytes that need special handling, everything else goes to the string as is.
+    const char stopbytes[] = { quote, '\\', '\n', '\r', '\0' };
 
     char c, after_backslash;
-    while( (c=read_byte(st)) != quote )
+    while(1)
     {
+        const char *p = skip_until_any_of(st->pos, st->end, stopbytes, sizeof stopbytes);
+        int n = (int)(p - st->pos);
+        if (n) {
+            // Grow once for the whole run, so long strings don't go through Append() byte by byte.
+            if (st->strbuf.alloc - st->strbuf.len < n) {
+                st->strbuf.alloc = max(2*st->strbuf.alloc, st->strbuf.len + n);
+                st->strbuf.ptr = realloc(st->strbuf.ptr, st->strbuf.alloc);
+                if (!st->strbuf.ptr) {
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+            }
+            memcpy(End(st->strbuf), st->pos, n);
+            st->strbuf.len += n;
+            st->pos = p;
+        }
+
+        if ((c = read_byte(st)) == quote)
+            break;
+
         switch(c) {
         case '\n':
             st->location.lineno--;  // to get error at the correct line number
@@ -192,15 +327,15 @@ static char *read_string(struct State *st, char quote, int *len)
             after_backslash = read_byte(st);
             switch(after_backslash) {
             case 'n':
-                Append(&result, '\n');
+                Append(&st->strbuf, '\n');
                 break;
             case 'r':
-                Append(&result, '\r');
+                Append(&st->strbuf, '\r');
                 break;
             case '\\':
             case '\'':
             case '"':
-                Append(&result, after_backslash);
+                Append(&st->strbuf, after_backslash);
                 break;
             case '0':
                 if (quote == '"')
@@ -215,7 +350,7 @@ static char *read_string(struct State *st, char quote, int *len)
             case '7':
             case '8':
             case '9':
-                Append(&result, after_backslash - '0');
+                Append(&st->strbuf, after_backslash - '0');
                 break;
             case '\n':
                 // \ at end of line, string continues on next line
@@ -235,15 +370,13 @@ static char *read_string(struct State *st, char quote, int *len)
             }
             break;
         default:
-            Append(&result, c);
+            Append(&st->strbuf, c);
             break;
         }
     }
 
-    if(len)
-        *len = result.len;
-    Append(&result, '\0');
-    return result.ptr;
+    Append(&st->strbuf, '\0');
+    return;
 
 missing_end_quote:
     // TODO: tests
@@ -255,15 +388,13 @@ missing_end_quote:
 
 static char read_char_literal(struct State *st)
 {
-    int len;
-    char *s = read_string(st, '\'', &len);
+    read_string(st, '\'');
+    int len = st->strbuf.len - 1;  // without '\0'
     if (len == 0)
         fail_with_error(st->location, "empty character literal: ''");
     if (len >= 2)
         fail_with_error(st->location, "single quotes are for a single character, maybe use double quotes to instead make a string?");
-    char result = s[0];
-    free(s);
-    return result;
+    return st->strbuf.ptr[0];
 }
 
 static const char *const operatorChars = "=<>!.,()[]{};:+-*/&";
@@ -317,17 +448,17 @@ static Token read_token(struct State *st)
         case '\n': read_indentation_as_newline_token(st, &t); break;
         case '\0': t.type = TOKEN_END_OF_FILE; break;
         case '\'': t.type = TOKEN_CHAR; t.data.char_value = read_char_literal(st); break;
-        case '"': t.type = TOKEN_STRING; t.data.string_value = read_string(st, '"', NULL); break;
+        case '"': t.type = TOKEN_STRING; read_string(st, '"'); t.data.string_value = strdup(st->strbuf.ptr); break;
         default:
             if(is_identifier_or_number_byte(c)) {
-                read_identifier_or_number(st, c, &t.data.name);
-                if (is_keyword(t.data.name))
-                    t.type = TOKEN_KEYWORD;
-                else if ('0'<=t.data.name[0] && t.data.name[0]<='9') {
+                char name[100];
+                read_identifier_or_number(st, c, &name);
+                if ('0'<=name[0] && name[0]<='9') {
                     t.type = TOKEN_INT;
-                    t.data.int_value = parse_integer(t.data.name, t.location);
+                    t.data.int_value = parse_integer(name, t.location);
                 } else {
-                    t.type = TOKEN_NAME;
+                    t.data.name = intern_name(name);
+                    t.type = name_is_keyword(t.data.name) ? TOKEN_KEYWORD : TOKEN_NAME;
                 }
             } else if (strchr(operatorChars, c)) {
                 unread_byte(st, c);
@@ -345,70 +476,79 @@ static Token read_token(struct State *st)
     }
 }
 
-static Token *tokenize_without_indent_dedent_tokens(const char *filename)
-{
-    struct State st = { .location.filename=filename, .f = fopen(filename, "rb") };
-    if (!st.f)
-        fail_with_error(st.location, "cannot open file: %s", strerror(errno));
-
-    /*
-    Add a fake newline to the beginning. It does a few things:
-      * Less special-casing: blank lines in the beginning of the file can
-        cause there to be a newline token anyway.
-      * It is easier to detect an unexpected indentation in the beginning
-        of the file, as it becomes just like any other indentation.
-      * Line numbers start at 1.
-    */
-    Append(&st.pushback, '\n');
+struct TokenStream {
+    struct State st;
+    char *source;  // contents of the file, see read_source_file()
 
-    List(Token) tokens = {0};
-    while(tokens.len == 0 || tokens.ptr[tokens.len-1].type != TOKEN_END_OF_FILE)
-        Append(&tokens, read_token(&st));
+    // Indent and dedent tokens are added after newline tokens that change the indentation level.
+    int level;  // indentation level after the indent and dedent tokens returned so far
+    int newline_level;  // indentation level of the latest newline token
+    Location indent_location;  // location for the indent and dedent tokens
+    bool got_end_of_file;  // read_token() returned TOKEN_END_OF_FILE
 
-    free(st.pushback.ptr);
-    fclose(st.f);
-    return tokens.ptr;
-}
+    List(Token) tokens;  // returned from read_toplevel_tokens()
+    int nused;  // how many tokens in the beginning the parser no longer needs, -1 if unknown
+};
 
-// Add indent/dedent tokens after newline tokens that change the indentation level.
-static Token *handle_indentations(const Token *temp_tokens)
+// Like read_token(), but also produces indent and dedent tokens as needed.
+static Token read_token_or_indentation(TokenStream *ts)
 {
-    List(Token) tokens = {0};
-    const Token *t = temp_tokens;
-    int level = 0;
-
-    do{
-        if (t->type == TOKEN_END_OF_FILE) {
-            // Add an extra newline token at end of file and the dedents after it.
-            // This makes it similar to how other newline and dedent tokens work:
-            // the dedents always come after a newline token.
-            Append(&tokens, (Token){ .location=t->location, .type=TOKEN_NEWLINE });
-            while(level) {
-                Append(&tokens, (Token){ .location=t->location, .type=TOKEN_DEDENT });
-                level -= 4;
-            }
-        }
+    if (ts->level < ts->newline_level) {
+        ts->level += 4;
+        return (Token){ .location=ts->indent_location, .type=TOKEN_INDENT };
+    }
+    if (ts->level > ts->newline_level) {
+        ts->level -= 4;
+        return (Token){ .location=ts->indent_location, .type=TOKEN_DEDENT };
+    }
+    if (ts->got_end_of_file)
+        return (Token){ .location=ts->indent_location, .type=TOKEN_END_OF_FILE };
+
+    Token t = read_token(&ts->st);
+
+    if (t.type == TOKEN_END_OF_FILE) {
+        // Add an extra newline token at end of file and the dedents after it.
+        // This makes it similar to how other newline and dedent tokens work:
+        // the dedents always come after a newline token.
+        ts->got_end_of_file = true;
+        ts->newline_level = 0;
+        ts->indent_location = t.location;
+        return (Token){ .location=t.location, .type=TOKEN_NEWLINE };
+    }
 
-        Append(&tokens, *t);
+    if (t.type == TOKEN_NEWLINE) {
+        Location after_newline = t.location;
+        after_newline.lineno++;
 
-        if (t->type == TOKEN_NEWLINE) {
-            Location after_newline = t->location;
-            after_newline.lineno++;
+        if (t.data.indentation_level % 4 != 0)
+            fail_with_error(after_newline, "indentation must be a multiple of 4 spaces");
 
-            if (t->data.indentation_level % 4 != 0)
-                fail_with_error(after_newline, "indentation must be a multiple of 4 spaces");
+        ts->newline_level = t.data.indentation_level;
+        ts->indent_location = after_newline;
+    }
 
-            while (level < t->data.indentation_level) {
-                Append(&tokens, (Token){ .location=after_newline, .type=TOKEN_INDENT });
-                level += 4;
-            }
+    return t;
+}
 
-            while (level > t->data.indentation_level) {
-                Append(&tokens, (Token){ .location=after_newline, .type=TOKEN_DEDENT });
-                level -= 4;
-            }
-        }
-    } while (t++->type != TOKEN_END_OF_FILE);
+TokenStream *open_token_stream(const char *filename)
+{
+    TokenStream *ts = calloc(1, sizeof *ts);
+    if (!ts) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    /*
+    read_source_file() adds a fake newline to the beginning. It does a few things:
+      * Less special-casing: blank lines in the beginning of the file can
+        cause there to be a newline token anyway.
+      * It is easier to detect an unexpected indentation in the beginning
+        of the file, as it becomes just like any other indentation.
+      * Line numbers start at 1.
+    */
+    size_t len;
+    ts->source = read_source_file(filename, &len);
+    ts->st = (struct State){ .location.filename=filename, .start=ts->source, .pos=ts->source, .end=&ts->source[len] };
 
     /*
     Delete the newline token in the beginning.
@@ -417,16 +557,82 @@ static Token *handle_indentations(const Token *temp_tokens)
     indent tokens and parsing will fail. If the file doesn't have any blank/comment
     lines in the beginning, it has a newline token anyway to avoid special casing.
     */
-    assert(tokens.ptr[0].type == TOKEN_NEWLINE);
-    memmove(&tokens.ptr[0], &tokens.ptr[1], sizeof(tokens.ptr[0]) * (tokens.len - 1));
+    Token first = read_token_or_indentation(ts);
+    assert(first.type == TOKEN_NEWLINE);
+    (void)first;
+
+    return ts;
+}
+
+static void discard_tokens(TokenStream *ts, int n)
+{
+    assert(0 <= n && n <= ts->tokens.len);
+    for (int i = 0; i < n; i++)
+        if (ts->tokens.ptr[i].type == TOKEN_STRING)
+            free(ts->tokens.ptr[i].data.string_value);
+    if (ts->tokens.len != n)
+        memmove(ts->tokens.ptr, &ts->tokens.ptr[n], sizeof(ts->tokens.ptr[0]) * (ts->tokens.len - n));
+    ts->tokens.len -= n;
+}
+
+/*
+A top-level definition ends with a newline or dedent token that brings the
+indentation back to zero. The returned tokens also include one token after
+that, so that the parser can show it in an error message if the definition
+is incomplete, e.g. "def foo():" followed by an unindented line.
+*/
+const Token *read_toplevel_tokens(TokenStream *ts)
+{
+    assert(ts->nused != -1);  // unread_tokens() not called after previous read_toplevel_tokens()
+    discard_tokens(ts, ts->nused);
+    ts->nused = -1;
+
+    bool done = false;
+    while (!done && (ts->tokens.len == 0 || End(ts->tokens)[-1].type != TOKEN_END_OF_FILE)) {
+        Token t = read_token_or_indentation(ts);
+        done = ts->level == 0 && ts->newline_level == 0 && (t.type == TOKEN_NEWLINE || t.type == TOKEN_DEDENT);
+        Append(&ts->tokens, t);
+    }
+    if (End(ts->tokens)[-1].type != TOKEN_END_OF_FILE)
+        Append(&ts->tokens, read_token_or_indentation(ts));
 
-    return tokens.ptr;
+    return ts->tokens.ptr;
 }
 
-Token *tokenize(const char *filename)
+void unread_tokens(TokenStream *ts, const Token *first_unused)
 {
-    Token *tokens1 = tokenize_without_indent_dedent_tokens(filename);
-    Token *tokens2 = handle_indentations(tokens1);
-    free(tokens1);
-    return tokens2;
+    assert(ts->tokens.ptr <= first_unused && first_unused < End(ts->tokens));
+    ts->nused = first_unused - ts->tokens.ptr;
+}
+
+void close_token_stream(TokenStream *ts)
+{
+    discard_tokens(ts, ts->tokens.len);
+    free(ts->tokens.ptr);
+    free(ts->st.strbuf.ptr);
+    free(ts->source);
+    free(ts);
+}
+
+Token *tokenize(const char *filename, Arena *arena)
+{
+    TokenStream *ts = open_token_stream(filename);
+    List(Token) result = {0};
+    const Token *t = read_toplevel_tokens(ts);
+
+    while(1) {
+        ArenaAppend(arena, &result, *t);
+        if (t->type == TOKEN_STRING)
+            End(result)[-1].data.string_value = arena_strdup(arena, t->data.string_value);
+        if (t->type == TOKEN_END_OF_FILE)
+            break;
+        if (++t == End(ts->tokens) - 1) {
+            // Only the lookahead token is left
+            unread_tokens(ts, t);
+            t = read_toplevel_tokens(ts);
+        }
+    }
+
+    close_token_stream(ts);
+    return result.ptr;
 }
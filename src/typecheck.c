@@ -3,33 +3,29 @@
 
 static const Variable *find_variable(const TypeContext *ctx, const char *name)
 {
-    for (Variable **var = ctx->variables.ptr; var < End(ctx->variables); var++)
-        if (!strcmp((*var)->name, name))
-            return *var;
-    return NULL;
+    int i = namemap_get(&ctx->variable_indexes, name);
+    return i == -1 ? NULL : ctx->variables.ptr[i];
 }
 
 static Variable *add_variable(TypeContext *ctx, const Type *t, const char *name)
 {
-    Variable *var = calloc(1, sizeof *var);
+    Variable *var = arena_alloc(ctx->arena, sizeof *var);
     var->id = ctx->variables.len;
     var->type = t;
 
     assert(name);
     assert(!find_variable(ctx, name));
-    assert(strlen(name) < sizeof var->name);
-    strcpy(var->name, name);
+    var->name = name;
 
+    namemap_set(&ctx->variable_indexes, name, ctx->variables.len);
     Append(&ctx->variables, var);
     return var;
 }
 
 static const Signature *find_function(const TypeContext *ctx, const char *name)
 {
-    for (Signature *sig = ctx->function_signatures.ptr; sig < End(ctx->function_signatures); sig++)
-        if (!strcmp(sig->funcname, name))
-            return sig;
-    return NULL;
+    int i = namemap_get(&ctx->function_indexes, name);
+    return i == -1 ? NULL : &ctx->function_signatures.ptr[i];
 }
 
 static const Type *type_or_void_from_ast(const TypeContext *ctx, const AstType *asttype)
@@ -37,27 +33,22 @@ static const Type *type_or_void_from_ast(const TypeContext *ctx, const AstType *
     int npointers = asttype->npointers;
     const Type *t;
 
-    if (!strcmp(asttype->name, "int"))
+    if (asttype->name == known_names.kw_int)
         t = intType;
-    else if (!strcmp(asttype->name, "byte"))
+    else if (asttype->name == known_names.kw_byte)
         t = byteType;
-    else if (!strcmp(asttype->name, "bool"))
+    else if (asttype->name == known_names.kw_bool)
         t = boolType;
-    else if (!strcmp(asttype->name, "void")) {
+    else if (asttype->name == known_names.kw_void) {
         if (npointers == 0)
             return NULL;
         npointers--;
         t = voidPtrType;
     } else {
-        t = NULL;
-        for (Type **ptr = ctx->structs.ptr; ptr < End(ctx->structs); ptr++) {
-            if (!strcmp((*ptr)->name, asttype->name)) {
-                t = *ptr;
-                break;
-            }
-        }
-        if(!t)
+        int i = namemap_get(&ctx->struct_indexes, asttype->name);
+        if (i == -1)
             fail_with_error(asttype->location, "there is no type named '%s'", asttype->name);
+        t = ctx->structs.ptr[i];
     }
 
     while (npointers--)
@@ -90,10 +81,10 @@ static noreturn void fail_with_implicit_cast_error(
     List(char) msg = {0};
     while(*template){
         if (!strncmp(template, "FROM", 4)) {
-            AppendStr(&msg, from->name);
+            AppendStr(&msg, type_name(from));
             template += 4;
         } else if (!strncmp(template, "TO", 2)) {
-            AppendStr(&msg, to->name);
+            AppendStr(&msg, type_name(to));
             template += 2;
         } else {
             Append(&msg, template[0]);
@@ -141,13 +132,13 @@ static void check_explicit_cast(const Type *from, const Type *to, Location locat
     )
     {
         // TODO: test this error
-        fail_with_error(location, "cannot cast from type %s to %s", from->name, to->name);
+        fail_with_error(location, "cannot cast from type %s to %s", type_name(from), type_name(to));
     }
 }
 
-static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpression *expr);
+static ExpressionTypes *typecheck_expression(TypeContext *ctx, AstExpression *expr);
 
-static ExpressionTypes *typecheck_expression_not_void(TypeContext *ctx, const AstExpression *expr)
+static ExpressionTypes *typecheck_expression_not_void(TypeContext *ctx, AstExpression *expr)
 {
     ExpressionTypes *types = typecheck_expression(ctx, expr);
     if (!types) {
@@ -160,7 +151,7 @@ static ExpressionTypes *typecheck_expression_not_void(TypeContext *ctx, const As
 
 static void typecheck_expression_with_implicit_cast(
     TypeContext *ctx,
-    const AstExpression *expr,
+    AstExpression *expr,
     const Type *casttype,
     const char *errormsg_template)
 {
@@ -207,7 +198,7 @@ static const Type *check_binop(
     );
 
     if (!got_integers && !(got_pointers && (op == AST_EXPR_EQ || op == AST_EXPR_NE)))
-        fail_with_error(location, "wrong types: cannot %s %s and %s", do_what, lhstypes->type->name, rhstypes->type->name);
+        fail_with_error(location, "wrong types: cannot %s %s and %s", do_what, type_name(lhstypes->type), type_name(rhstypes->type));
 
     // TODO: is this a good idea?
     const Type *cast_type;
@@ -282,7 +273,7 @@ static const char *short_expression_description(const AstExpression *expr)
         return "the result of decrementing a value";
 
     case AST_EXPR_ADDRESS_OF:
-        snprintf(result, sizeof result, "address of %s", short_expression_description(&expr->data.operands[0]));
+        snprintf(result, sizeof result, "address of %s", short_expression_description(expr->data.operands[0]));
         break;
 
     case AST_EXPR_GET_FIELD:
@@ -313,14 +304,14 @@ static void ensure_can_take_address(const AstExpression *expr, const char *errms
         break;
     case AST_EXPR_GET_FIELD:
         // &foo.bar = &foo + offset
-        ensure_can_take_address(&expr->data.operands[0], errmsg_template);
+        ensure_can_take_address(expr->data.operands[0], errmsg_template);
         break;
     default:
         fail_with_error(expr->location, errmsg_template, short_expression_description(expr));
     }
 }
 
-static const Type *check_increment_or_decrement(TypeContext *ctx, const AstExpression *expr)
+static const Type *check_increment_or_decrement(TypeContext *ctx, AstExpression *expr)
 {
     const char *bad_type_fmt, *bad_expr_fmt;
     switch(expr->kind) {
@@ -338,10 +329,10 @@ static const Type *check_increment_or_decrement(TypeContext *ctx, const AstExpre
         assert(0);
     }
 
-    ensure_can_take_address(&expr->data.operands[0], bad_expr_fmt);
-    const Type *t = typecheck_expression_not_void(ctx, &expr->data.operands[0])->type;
+    ensure_can_take_address(expr->data.operands[0], bad_expr_fmt);
+    const Type *t = typecheck_expression_not_void(ctx, expr->data.operands[0])->type;
     if (!is_integer_type(t) && !is_pointer_type(t))
-        fail_with_error(expr->location, bad_type_fmt, t->name);
+        fail_with_error(expr->location, bad_type_fmt, type_name(t));
     return t;
 }
 
@@ -349,30 +340,30 @@ static void typecheck_dereferenced_pointer(Location location, const Type *t)
 {
     // TODO: improved error message for dereferencing void*
     if (t->kind != TYPE_POINTER)
-        fail_with_error(location, "the dereference operator '*' is only for pointers, not for %s", t->name);
+        fail_with_error(location, "the dereference operator '*' is only for pointers, not for %s", type_name(t));
 }
 
 // ptr[index]
 static const Type *typecheck_indexing(
-    TypeContext *ctx, const AstExpression *ptrexpr, const AstExpression *indexexpr)
+    TypeContext *ctx, AstExpression *ptrexpr, AstExpression *indexexpr)
 {
     const Type *ptrtype = typecheck_expression_not_void(ctx, ptrexpr)->type;
     if (ptrtype->kind != TYPE_POINTER)
-        fail_with_error(ptrexpr->location, "value of type %s cannot be indexed", ptrtype->name);
+        fail_with_error(ptrexpr->location, "value of type %s cannot be indexed", type_name(ptrtype));
 
     const Type *indextype = typecheck_expression_not_void(ctx, indexexpr)->type;
     if (!is_integer_type(indextype)) {
         fail_with_error(
             indexexpr->location,
             "the index inside [...] must be an integer, not %s",
-            indextype->name);
+            type_name(indextype));
     }
 
     return ptrtype->data.valuetype;
 }
 
 static void typecheck_and_or(
-    TypeContext *ctx, const AstExpression *lhsexpr, const AstExpression *rhsexpr, const char *and_or)
+    TypeContext *ctx, AstExpression *lhsexpr, AstExpression *rhsexpr, const char *and_or)
 {
     assert(!strcmp(and_or, "and") || !strcmp(and_or, "or"));
     char errormsg[100];
@@ -396,7 +387,7 @@ static const char *nth(int n)
 }
 
 // returns NULL if the function doesn't return anything, otherwise non-owned pointer to non-owned type
-static const Type *typecheck_function_call(TypeContext *ctx, const AstCall *call, Location location)
+static const Type *typecheck_function_call(TypeContext *ctx, AstCall *call, Location location)
 {
     const Signature *sig = find_function(ctx, call->calledname);
     if (!sig)
@@ -419,11 +410,11 @@ static const Type *typecheck_function_call(TypeContext *ctx, const AstCall *call
         // This is a common error, so worth spending some effort to get a good error message.
         char msg[500];
         snprintf(msg, sizeof msg, "%s argument of function %s should have type TO, not FROM", nth(i+1), sigstr);
-        typecheck_expression_with_implicit_cast(ctx, &call->args[i], sig->argtypes[i], msg);
+        typecheck_expression_with_implicit_cast(ctx, call->args[i], sig->argtypes[i], msg);
     }
     for (int i = sig->nargs; i < call->nargs; i++) {
         // This code runs for varargs, e.g. the things to format in printf().
-        typecheck_expression_not_void(ctx, &call->args[i]);
+        typecheck_expression_not_void(ctx, call->args[i]);
     }
 
     free(sigstr);
@@ -435,17 +426,16 @@ static const Type *typecheck_struct_field(
 {
     assert(structtype->kind == TYPE_STRUCT);
 
-    for (int i = 0; i < structtype->data.structfields.count; i++)
-        if (!strcmp(structtype->data.structfields.names[i], fieldname))
-            return structtype->data.structfields.types[i];
+    int i = find_struct_field(structtype, fieldname);
+    if (i != -1)
+        return structtype->data.structfields.types[i];
 
-    fail_with_error(location, "struct %s has no field named '%s'", structtype->name, fieldname);
+    fail_with_error(location, "struct %s has no field named '%s'", type_name(structtype), fieldname);
 }
 
-static const Type *typecheck_struct_init(TypeContext *ctx, const AstCall *call, Location location)
+static const Type *typecheck_struct_init(TypeContext *ctx, AstCall *call, Location location)
 {
-    struct AstType tmp = { .location = location, .npointers = 0 };
-    safe_strcpy(tmp.name, call->calledname);
+    struct AstType tmp = { .location = location, .name = call->calledname, .npointers = 0 };
     const Type *t = type_from_ast(ctx, &tmp);
 
     if (t->kind != TYPE_STRUCT) {
@@ -453,22 +443,22 @@ static const Type *typecheck_struct_init(TypeContext *ctx, const AstCall *call,
         // all non-struct types are created with keywords, and this
         // function is called only when there is a name token followed
         // by a '{'.
-        fail_with_error(location, "type %s cannot be instantiated with the Foo{...} syntax", t->name);
+        fail_with_error(location, "type %s cannot be instantiated with the Foo{...} syntax", type_name(t));
     }
 
     for (int i = 0; i < call->nargs; i++) {
-        const Type *fieldtype = typecheck_struct_field(t, call->argnames[i], call->args[i].location);
+        const Type *fieldtype = typecheck_struct_field(t, call->argnames[i], call->args[i]->location);
         char msg[1000];
         snprintf(msg, sizeof msg,
             "value for field '%s' of struct %s must be of type TO, not FROM",
             call->argnames[i], call->calledname);
-        typecheck_expression_with_implicit_cast(ctx, &call->args[i], fieldtype, msg);
+        typecheck_expression_with_implicit_cast(ctx, call->args[i], fieldtype, msg);
     }
 
     return t;
 }
 
-static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpression *expr)
+static ExpressionTypes *typecheck_expression(TypeContext *ctx, AstExpression *expr)
 {
     const Type *temptype;
     const Type *result;
@@ -477,8 +467,10 @@ static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpressi
     case AST_EXPR_FUNCTION_CALL:
         {
             const Type *ret = typecheck_function_call(ctx, &expr->data.call, expr->location);
-            if (!ret)
+            if (!ret) {
+                expr->types = (ExpressionTypes){0};
                 return NULL;
+            }
             result = ret;
         }
         break;
@@ -491,7 +483,7 @@ static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpressi
             fail_with_error(
                 expr->location,
                 "left side of the '.' operator must be a struct, not %s",
-                temptype->name);
+                type_name(temptype));
         result = typecheck_struct_field(temptype, expr->data.field.fieldname, expr->location);
         break;
     case AST_EXPR_DEREF_AND_GET_FIELD:
@@ -500,15 +492,15 @@ static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpressi
             fail_with_error(
                 expr->location,
                 "left side of the '->' operator must be a pointer to a struct, not %s",
-                temptype->name);
+                type_name(temptype));
         result = typecheck_struct_field(temptype->data.valuetype, expr->data.field.fieldname, expr->location);
         break;
     case AST_EXPR_INDEXING:
-        result = typecheck_indexing(ctx, &expr->data.operands[0], &expr->data.operands[1]);
+        result = typecheck_indexing(ctx, expr->data.operands[0], expr->data.operands[1]);
         break;
     case AST_EXPR_ADDRESS_OF:
-        ensure_can_take_address(&expr->data.operands[0], "the '&' operator cannot be used with %s");
-        temptype = typecheck_expression_not_void(ctx, &expr->data.operands[0])->type;
+        ensure_can_take_address(expr->data.operands[0], "the '&' operator cannot be used with %s");
+        temptype = typecheck_expression_not_void(ctx, expr->data.operands[0])->type;
         result = get_pointer_type(temptype);
         break;
     case AST_EXPR_GET_VARIABLE:
@@ -520,7 +512,7 @@ static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpressi
         }
         break;
     case AST_EXPR_DEREFERENCE:
-        temptype = typecheck_expression_not_void(ctx, &expr->data.operands[0])->type;
+        temptype = typecheck_expression_not_void(ctx, expr->data.operands[0])->type;
         typecheck_dereferenced_pointer(expr->location, temptype);
         result = temptype->data.valuetype;
         break;
@@ -528,16 +520,16 @@ static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpressi
         result = type_of_constant(&expr->data.constant);
         break;
     case AST_EXPR_AND:
-        typecheck_and_or(ctx, &expr->data.operands[0], &expr->data.operands[1], "and");
+        typecheck_and_or(ctx, expr->data.operands[0], expr->data.operands[1], "and");
         result = boolType;
         break;
     case AST_EXPR_OR:
-        typecheck_and_or(ctx, &expr->data.operands[0], &expr->data.operands[1], "or");
+        typecheck_and_or(ctx, expr->data.operands[0], expr->data.operands[1], "or");
         result = boolType;
         break;
     case AST_EXPR_NOT:
         typecheck_expression_with_implicit_cast(
-            ctx, &expr->data.operands[0], boolType,
+            ctx, expr->data.operands[0], boolType,
             "value after 'not' must be a boolean, not FROM");
         result = boolType;
         break;
@@ -552,8 +544,8 @@ static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpressi
     case AST_EXPR_LT:
     case AST_EXPR_LE:
         {
-            ExpressionTypes *lhstypes = typecheck_expression_not_void(ctx, &expr->data.operands[0]);
-            ExpressionTypes *rhstypes = typecheck_expression_not_void(ctx, &expr->data.operands[1]);
+            ExpressionTypes *lhstypes = typecheck_expression_not_void(ctx, expr->data.operands[0]);
+            ExpressionTypes *rhstypes = typecheck_expression_not_void(ctx, expr->data.operands[1]);
             result = check_binop(expr->kind, expr->location, lhstypes, rhstypes);
             break;
         }
@@ -570,22 +562,19 @@ static ExpressionTypes *typecheck_expression(TypeContext *ctx, const AstExpressi
         break;
     }
 
-    ExpressionTypes *types = calloc(1, sizeof *types);
-    types->expr = expr;
-    types->type = result;
-    Append(&ctx->expr_types, types);
-    return types;
+    expr->types = (ExpressionTypes){ .type = result };
+    return &expr->types;
 }
 
-static void typecheck_statement(TypeContext *ctx, const AstStatement *stmt);
+static void typecheck_statement(TypeContext *ctx, AstStatement *stmt);
 
-static void typecheck_body(TypeContext *ctx, const AstBody *body)
+static void typecheck_body(TypeContext *ctx, AstBody *body)
 {
     for (int i = 0; i < body->nstatements; i++)
-        typecheck_statement(ctx, &body->statements[i]);
+        typecheck_statement(ctx, body->statements[i]);
 }
 
-static void typecheck_if_statement(TypeContext *ctx, const AstIfStatement *ifstmt)
+static void typecheck_if_statement(TypeContext *ctx, AstIfStatement *ifstmt)
 {
     for (int i = 0; i < ifstmt->n_if_and_elifs; i++) {
         const char *errmsg;
@@ -595,13 +584,13 @@ static void typecheck_if_statement(TypeContext *ctx, const AstIfStatement *ifstm
             errmsg = "'elif' condition must be a boolean, not FROM";
 
         typecheck_expression_with_implicit_cast(
-            ctx, &ifstmt->if_and_elifs[i].condition, boolType, errmsg);
+            ctx, ifstmt->if_and_elifs[i].condition, boolType, errmsg);
         typecheck_body(ctx, &ifstmt->if_and_elifs[i].body);
     }
     typecheck_body(ctx, &ifstmt->elsebody);
 }
 
-static void typecheck_statement(TypeContext *ctx, const AstStatement *stmt)
+static void typecheck_statement(TypeContext *ctx, AstStatement *stmt)
 {
     switch(stmt->kind) {
     case AST_STMT_IF:
@@ -610,7 +599,7 @@ static void typecheck_statement(TypeContext *ctx, const AstStatement *stmt)
 
     case AST_STMT_WHILE:
         typecheck_expression_with_implicit_cast(
-            ctx, &stmt->data.whileloop.condition, boolType,
+            ctx, stmt->data.whileloop.condition, boolType,
             "'while' condition must be a boolean, not FROM");
         typecheck_body(ctx, &stmt->data.whileloop.body);
         break;
@@ -618,7 +607,7 @@ static void typecheck_statement(TypeContext *ctx, const AstStatement *stmt)
     case AST_STMT_FOR:
         typecheck_statement(ctx, stmt->data.forloop.init);
         typecheck_expression_with_implicit_cast(
-            ctx, &stmt->data.forloop.cond, boolType,
+            ctx, stmt->data.forloop.cond, boolType,
             "'for' condition must be a boolean, not FROM");
         typecheck_body(ctx, &stmt->data.forloop.body);
         typecheck_statement(ctx, stmt->data.forloop.incr);
@@ -632,8 +621,8 @@ static void typecheck_statement(TypeContext *ctx, const AstStatement *stmt)
 
     case AST_STMT_ASSIGN:
         {
-            const AstExpression *targetexpr = &stmt->data.assignment.target;
-            const AstExpression *valueexpr = &stmt->data.assignment.value;
+            AstExpression *targetexpr = stmt->data.assignment.target;
+            AstExpression *valueexpr = stmt->data.assignment.value;
             if (targetexpr->kind == AST_EXPR_GET_VARIABLE
                 && !find_variable(ctx, targetexpr->data.varname))
             {
@@ -673,7 +662,7 @@ static void typecheck_statement(TypeContext *ctx, const AstStatement *stmt)
             "attempting to return a value of type FROM from function '%s' defined with '-> TO'",
             ctx->current_function_signature->funcname);
         typecheck_expression_with_implicit_cast(
-            ctx, &stmt->data.expression, find_variable(ctx, "return")->type, msg);
+            ctx, stmt->data.expression, find_variable(ctx, known_names.kw_return)->type, msg);
         break;
     }
 
@@ -683,7 +672,7 @@ static void typecheck_statement(TypeContext *ctx, const AstStatement *stmt)
                 stmt->location,
                 "a return value is needed, because the return type of function '%s' is %s",
                 ctx->current_function_signature->funcname,
-                ctx->current_function_signature->returntype->name);
+                type_name(ctx->current_function_signature->returntype));
         }
         break;
 
@@ -701,23 +690,22 @@ static void typecheck_statement(TypeContext *ctx, const AstStatement *stmt)
         break;
 
     case AST_STMT_EXPRESSION_STATEMENT:
-        typecheck_expression(ctx, &stmt->data.expression);
+        typecheck_expression(ctx, stmt->data.expression);
         break;
     }
 }
 
-void typecheck_function(TypeContext *ctx, Location funcname_location, const AstSignature *astsig, const AstBody *body)
+const Signature *typecheck_function(TypeContext *ctx, Location funcname_location, const AstSignature *astsig, AstBody *body)
 {
-    for (Signature *sig = ctx->function_signatures.ptr; sig < End(ctx->function_signatures); sig++)
-        if (!strcmp(sig->funcname, astsig->funcname))
-            fail_with_error(funcname_location, "a function named '%s' already exists", astsig->funcname);
+    if (find_function(ctx, astsig->funcname))
+        fail_with_error(funcname_location, "a function named '%s' already exists", astsig->funcname);
 
-    Signature sig = { .nargs = astsig->nargs, .takes_varargs = astsig->takes_varargs };
-    safe_strcpy(sig.funcname, astsig->funcname);
+    Signature sig = { .funcname = astsig->funcname, .nargs = astsig->nargs, .takes_varargs = astsig->takes_varargs };
 
     size_t size = sizeof(sig.argnames[0]) * sig.nargs;
     sig.argnames = malloc(size);
-    memcpy(sig.argnames, astsig->argnames, size);
+    if (sig.nargs)
+        memcpy(sig.argnames, astsig->argnames, size);
 
     sig.argtypes = malloc(sizeof(sig.argtypes[0]) * sig.nargs);  // NOLINT
     for (int i = 0; i < sig.nargs; i++)
@@ -726,17 +714,17 @@ void typecheck_function(TypeContext *ctx, Location funcname_location, const AstS
     sig.returntype = type_or_void_from_ast(ctx, &astsig->returntype);
     // TODO: validate main() parameters
     // TODO: test main() taking parameters
-    if (!strcmp(sig.funcname, "main") && sig.returntype != intType) {
+    if (sig.funcname == known_names.main && sig.returntype != intType) {
         fail_with_error(astsig->returntype.location, "the main() function must return int");
     }
 
     sig.returntype_location = astsig->returntype.location;
 
     assert(ctx->current_function_signature == NULL);
-    assert(ctx->expr_types.len == 0);
     assert(ctx->variables.len == 0);
 
     // Make signature of current function usable in function calls (recursion)
+    namemap_set(&ctx->function_indexes, sig.funcname, ctx->function_signatures.len);
     Append(&ctx->function_signatures, sig);
     ctx->current_function_signature = &ctx->function_signatures.ptr[ctx->function_signatures.len - 1];
 
@@ -746,23 +734,23 @@ void typecheck_function(TypeContext *ctx, Location funcname_location, const AstS
             v->is_argument = true;
         }
         if (sig.returntype)
-            add_variable(ctx, sig.returntype, "return");
+            add_variable(ctx, sig.returntype, known_names.kw_return);
 
         typecheck_body(ctx, body);
     }
 
     ctx->current_function_signature = NULL;
+    return &ctx->function_signatures.ptr[ctx->function_signatures.len - 1];
 }
 
 void typecheck_struct(struct TypeContext *ctx, const AstStructDef *structdef, Location location)
 {
-    for (Type **t = ctx->structs.ptr; t < End(ctx->structs); t++)
-        if (!strcmp((*t)->name, structdef->name))
-            fail_with_error(location, "a struct named '%s' already exists", structdef->name);
+    if (namemap_get(&ctx->struct_indexes, structdef->name) != -1)
+        fail_with_error(location, "a struct named '%s' already exists", structdef->name);
 
     int n = structdef->nfields;
 
-    char (*fieldnames)[100] = malloc(n * sizeof(fieldnames[0]));
+    const char **fieldnames = malloc(n * sizeof(fieldnames[0]));  // NOLINT
     memcpy(fieldnames, structdef->fieldnames, n * sizeof(fieldnames[0]));
 
     const Type **fieldtypes = malloc(n * sizeof fieldtypes[0]);  // NOLINT
@@ -770,22 +758,26 @@ void typecheck_struct(struct TypeContext *ctx, const AstStructDef *structdef, Lo
         fieldtypes[i] = type_from_ast(ctx, &structdef->fieldtypes[i]);
 
     Type *structtype = create_struct(structdef->name, n, fieldnames, fieldtypes);
+    namemap_set(&ctx->struct_indexes, structdef->name, ctx->structs.len);
     Append(&ctx->structs, structtype);
 }
 
 void reset_type_context(TypeContext *ctx)
 {
-    for (ExpressionTypes **et = ctx->expr_types.ptr; et < End(ctx->expr_types); et++)
-        free(*et);
-    ctx->expr_types.len = 0;
     ctx->variables.len = 0;
+    namemap_clear(&ctx->variable_indexes);
 }
 
 void destroy_type_context(const TypeContext *ctx)
 {
-    free(ctx->expr_types.ptr);
     free(ctx->variables.ptr);
     for (Type **t = ctx->structs.ptr; t < End(ctx->structs); t++)
         free_type(*t);
     free(ctx->structs.ptr);
+    for (Signature *sig = ctx->function_signatures.ptr; sig < End(ctx->function_signatures); sig++)
+        free_signature(sig);
+    free(ctx->function_signatures.ptr);
+    namemap_free(&ctx->variable_indexes);
+    namemap_free(&ctx->struct_indexes);
+    namemap_free(&ctx->function_indexes);
 }
@@ -5,15 +5,30 @@
 #include <string.h>
 #include "jou_compiler.h"
 
+/*
+Types are hash-consed: a type built from other types, such as a pointer type,
+is looked up from a hash table before creating it, so there is only one Type
+object for each type, and types can be compared with "==".
+
+Every type built from other types is also in the "derived" list of the types
+it's built from, so that freeing a struct can also free its pointer types.
+*/
 struct TypeInfo {
     Type type;
-    struct TypeInfo *pointer;  // type that represents a pointer to this type, or NULL
+    char *name;  // NULL until type_name() is called, except for structs
+    LLVMTypeRef llvmtype;  // see get_llvm_type_cache()
+    struct TypeInfo *hashnext;  // next type in the same hash table bucket
+    List(struct TypeInfo *) derived;
 };
 
 static struct {
     bool inited;
     struct TypeInfo integers[65][2];  // integers[i][j] = i-bit integer, j=1 for signed, j=0 for unsigned
     struct TypeInfo boolean, voidptr;
+
+    // Hash table of types built from other types, with chaining.
+    struct TypeInfo **buckets;
+    size_t nbuckets, count;
 } global_state;
 
 const Type *boolType = &global_state.boolean.type;
@@ -21,58 +36,240 @@ const Type *intType = &global_state.integers[32][true].type;
 const Type *byteType = &global_state.integers[8][false].type;
 const Type *voidPtrType = &global_state.voidptr.type;
 
-void free_type(Type *t)
+static struct TypeInfo *get_info(const Type *t)
+{
+    assert(offsetof(struct TypeInfo, type) == 0);
+    return (struct TypeInfo *)t;
+}
+
+/*
+Components are the types that a type is built from, such as the value type of
+a pointer type. When adding a new kind of type that is built from other types,
+also update hash_type() and same_components().
+*/
+static int get_components(const Type *t, const Type **components)
+{
+    switch(t->kind) {
+    case TYPE_POINTER:
+        components[0] = t->data.valuetype;
+        return 1;
+    case TYPE_SIGNED_INTEGER:
+    case TYPE_UNSIGNED_INTEGER:
+    case TYPE_BOOL:
+    case TYPE_VOID_POINTER:
+    case TYPE_STRUCT:
+        return 0;
+    }
+    assert(0);
+}
+
+static size_t hash_type(const Type *t)
+{
+    size_t h = (size_t)t->kind;
+    switch(t->kind) {
+    case TYPE_POINTER:
+        h = h*31 + (size_t)t->data.valuetype;
+        break;
+    case TYPE_SIGNED_INTEGER:
+    case TYPE_UNSIGNED_INTEGER:
+    case TYPE_BOOL:
+    case TYPE_VOID_POINTER:
+    case TYPE_STRUCT:
+        assert(0);  // these are not built from other types
+    }
+    return h ^ (h >> 17);
+}
+
+static bool same_components(const Type *a, const Type *b)
+{
+    if (a->kind != b->kind)
+        return false;
+    switch(a->kind) {
+    case TYPE_POINTER:
+        return a->data.valuetype == b->data.valuetype;
+    case TYPE_SIGNED_INTEGER:
+    case TYPE_UNSIGNED_INTEGER:
+    case TYPE_BOOL:
+    case TYPE_VOID_POINTER:
+    case TYPE_STRUCT:
+        assert(0);
+    }
+    assert(0);
+}
+
+static void add_to_hash_table(struct TypeInfo *info)
+{
+    if (2*(global_state.count + 1) > global_state.nbuckets) {
+        size_t newcount = global_state.nbuckets ? 2*global_state.nbuckets : 64;
+        struct TypeInfo **newbuckets = calloc(newcount, sizeof newbuckets[0]);
+        for (size_t i = 0; i < global_state.nbuckets; i++) {
+            struct TypeInfo *next;
+            for (struct TypeInfo *t = global_state.buckets[i]; t; t = next) {
+                next = t->hashnext;
+                size_t j = hash_type(&t->type) % newcount;
+                t->hashnext = newbuckets[j];
+                newbuckets[j] = t;
+            }
+        }
+        free(global_state.buckets);
+        global_state.buckets = newbuckets;
+        global_state.nbuckets = newcount;
+    }
+
+    struct TypeInfo **bucket = &global_state.buckets[hash_type(&info->type) % global_state.nbuckets];
+    info->hashnext = *bucket;
+    *bucket = info;
+    global_state.count++;
+}
+
+static void remove_from_hash_table(struct TypeInfo *info)
+{
+    struct TypeInfo **ptr = &global_state.buckets[hash_type(&info->type) % global_state.nbuckets];
+    while (*ptr != info)
+        ptr = &(*ptr)->hashnext;
+    *ptr = info->hashnext;
+    global_state.count--;
+}
+
+/*
+Returns the only type whose components are same as in the given type.
+The components are types, such as the value type of a pointer type.
+The type is created if it doesn't exist yet.
+*/
+static const Type *find_or_create_type(Type key)
+{
+    if (global_state.nbuckets) {
+        for (struct TypeInfo *t = global_state.buckets[hash_type(&key) % global_state.nbuckets]; t; t = t->hashnext)
+            if (same_components(&t->type, &key))
+                return &t->type;
+    }
+
+    struct TypeInfo *info = calloc(1, sizeof *info);
+    info->type = key;
+    add_to_hash_table(info);
+
+    const Type *components[2];
+    int ncomponents = get_components(&key, components);
+    assert(ncomponents > 0);
+    for (int i = 0; i < ncomponents; i++)
+        Append(&get_info(components[i])->derived, info);
+    return &info->type;
+}
+
+// Frees all types built from the given type, but not the type itself.
+static void free_derived_types(struct TypeInfo *info)
 {
-    while(t) {
-        if (t->kind == TYPE_STRUCT) {
-            free(t->data.structfields.types);
-            free(t->data.structfields.names);
+    while (info->derived.len) {
+        struct TypeInfo *d = Pop(&info->derived);
+
+        // If the type is built from several types, it is also in their derived lists.
+        const Type *components[2];
+        int ncomponents = get_components(&d->type, components);
+        for (int i = 0; i < ncomponents; i++) {
+            struct TypeInfo *c = get_info(components[i]);
+            for (int k = c->derived.len - 1; k >= 0; k--)
+                if (c->derived.ptr[k] == d)
+                    c->derived.ptr[k] = Pop(&c->derived);
         }
 
-        assert(offsetof(struct TypeInfo, type) == 0);
-        Type *next = &((struct TypeInfo *)t)->pointer->type;
-        free(t);
-        t = next;
+        remove_from_hash_table(d);
+        free_derived_types(d);
+        free(d->name);
+        free(d);
     }
+    free(info->derived.ptr);
+    info->derived.ptr = NULL;
+    info->derived.alloc = 0;
+}
+
+void free_type(Type *t)
+{
+    assert(t->kind == TYPE_STRUCT);
+    struct TypeInfo *info = get_info(t);
+    free_derived_types(info);
+    free(t->data.structfields.types);
+    free(t->data.structfields.names);
+    namemap_free(&t->data.structfields.indexes);
+    free(info->name);
+    free(info);
 }
 
 static void free_global_state(void)
 {
     assert(global_state.inited);
-    free_type(&global_state.boolean.pointer->type);
-    free_type(&global_state.voidptr.pointer->type);
-    for (int size = 8; size <= 64; size *= 2)
-        for (int is_signed = 0; is_signed <= 1; is_signed++)
-            free_type(&global_state.integers[size][is_signed].pointer->type);
+    free_derived_types(&global_state.boolean);
+    free_derived_types(&global_state.voidptr);
+    free(global_state.boolean.name);
+    free(global_state.voidptr.name);
+    for (int size = 8; size <= 64; size *= 2) {
+        for (int is_signed = 0; is_signed <= 1; is_signed++) {
+            free_derived_types(&global_state.integers[size][is_signed]);
+            free(global_state.integers[size][is_signed].name);
+        }
+    }
+    assert(global_state.count == 0);
+    free(global_state.buckets);
 }
 
 void init_types(void)
 {
     assert(!global_state.inited);
 
-    global_state.boolean.type = (Type){ .name = "bool", .kind = TYPE_BOOL };
-    global_state.voidptr.type = (Type){ .name = "void*", .kind = TYPE_VOID_POINTER };
+    global_state.boolean.type = (Type){ .kind = TYPE_BOOL };
+    global_state.voidptr.type = (Type){ .kind = TYPE_VOID_POINTER };
 
     for (int size = 8; size <= 64; size *= 2) {
         global_state.integers[size][true].type.kind = TYPE_SIGNED_INTEGER;
         global_state.integers[size][false].type.kind = TYPE_UNSIGNED_INTEGER;
-
-        for (int is_signed = 0; is_signed <= 1; is_signed++) {
+        for (int is_signed = 0; is_signed <= 1; is_signed++)
             global_state.integers[size][is_signed].type.data.width_in_bits = size;
-            sprintf(
-                global_state.integers[size][is_signed].type.name,
-                "<%d-bit %s integer>",
-                size, is_signed?"signed":"unsigned");
-        }
     }
 
-    strcpy(global_state.integers[8][false].type.name, "byte");
-    strcpy(global_state.integers[32][true].type.name, "int");
-
     global_state.inited = true;
     atexit(free_global_state);  // not really necessary, but makes valgrind happier
 }
 
+const char *type_name(const Type *t)
+{
+    struct TypeInfo *info = get_info(t);
+    if (info->name)
+        return info->name;
+
+    List(char) name = {0};
+    char buf[100];
+
+    switch(t->kind) {
+    case TYPE_SIGNED_INTEGER:
+    case TYPE_UNSIGNED_INTEGER:
+        if (t == byteType)
+            AppendStr(&name, "byte");
+        else if (t == intType)
+            AppendStr(&name, "int");
+        else {
+            snprintf(buf, sizeof buf, "<%d-bit %s integer>",
+                t->data.width_in_bits, t->kind == TYPE_SIGNED_INTEGER ? "signed" : "unsigned");
+            AppendStr(&name, buf);
+        }
+        break;
+    case TYPE_BOOL:
+        AppendStr(&name, "bool");
+        break;
+    case TYPE_VOID_POINTER:
+        AppendStr(&name, "void*");
+        break;
+    case TYPE_POINTER:
+        AppendStr(&name, type_name(t->data.valuetype));
+        Append(&name, '*');
+        break;
+    case TYPE_STRUCT:
+        assert(0);  // name is set when creating the struct
+    }
+
+    Append(&name, '\0');
+    info->name = name.ptr;
+    return info->name;
+}
+
 const Type *type_bool(void)
 {
     return &global_state.boolean.type;
@@ -86,15 +283,7 @@ const Type *get_integer_type(int size_in_bits, bool is_signed)
 
 const Type *get_pointer_type(const Type *t)
 {
-    assert(offsetof(struct TypeInfo, type) == 0);
-    struct TypeInfo *info = (struct TypeInfo *)t;
-
-    if (!info->pointer) {
-        info->pointer = calloc(1, sizeof *info->pointer);
-        info->pointer->type = (Type){ .kind=TYPE_POINTER, .data.valuetype=t };
-        snprintf(info->pointer->type.name, sizeof info->pointer->type.name, "%s*", t->name);
-    }
-    return &info->pointer->type;
+    return find_or_create_type((Type){ .kind=TYPE_POINTER, .data.valuetype=t });
 }
 
 bool is_integer_type(const Type *t)
@@ -122,20 +311,32 @@ const Type *type_of_constant(const Constant *c)
     assert(0);
 }
 
-Type *create_struct(const char *name, int fieldcount, char (*fieldnames)[100], const Type **fieldtypes)
+Type *create_struct(const char *name, int fieldcount, const char **fieldnames, const Type **fieldtypes)
 {
     struct TypeInfo *result = calloc(1, sizeof *result);
     result->type = (Type){
         .kind = TYPE_STRUCT,
         .data.structfields = {.count=fieldcount, .types=fieldtypes, .names=fieldnames},
     };
+    result->name = strdup(name);
 
-    assert(strlen(name) < sizeof result->type.name);
-    strcpy(result->type.name, name);
+    for (int i = 0; i < fieldcount; i++)
+        namemap_set(&result->type.data.structfields.indexes, fieldnames[i], i);
 
     return &result->type;
 }
 
+int find_struct_field(const Type *structtype, const char *fieldname)
+{
+    assert(structtype->kind == TYPE_STRUCT);
+    return namemap_get(&structtype->data.structfields.indexes, fieldname);
+}
+
+LLVMTypeRef *get_llvm_type_cache(const Type *t)
+{
+    return &get_info(t)->llvmtype;
+}
+
 
 char *signature_to_string(const Signature *sig, bool include_return_type)
 {
@@ -148,7 +349,7 @@ char *signature_to_string(const Signature *sig, bool include_return_type)
             AppendStr(&result, ", ");
         AppendStr(&result, sig->argnames[i]);
         AppendStr(&result, ": ");
-        AppendStr(&result, sig->argtypes[i]->name);
+        AppendStr(&result, type_name(sig->argtypes[i]));
     }
     if (sig->takes_varargs) {
         if (sig->nargs)
@@ -158,7 +359,7 @@ char *signature_to_string(const Signature *sig, bool include_return_type)
     Append(&result, ')');
     if (include_return_type) {
         AppendStr(&result, " -> ");
-        AppendStr(&result, sig->returntype ? sig->returntype->name : "void");
+        AppendStr(&result, sig->returntype ? type_name(sig->returntype) : "void");
     }
     Append(&result, '\0');
     return result.ptr;
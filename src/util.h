@@ -2,6 +2,8 @@
 #define UTIL_H
 
 #include <assert.h>
+#include <stdalign.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -79,6 +81,96 @@ Gotchas to watch out for:
     while(*appendstr_s) Append((list),*appendstr_s++); \
 } while(0)
 
+/*
+An Arena is a place to allocate many small things that are all freed at once.
+Each compilation step has its own arena, and freeing the result of a step is
+just one arena_free(). Example:
+
+    Arena arena = {0};
+    Foo *foo = arena_alloc(&arena, sizeof *foo);  // zeroed, like calloc()
+    List(int) nums = {0};
+    ArenaAppend(&arena, &nums, 123);
+    ...
+    arena_free(&arena);  // frees foo and nums
+
+Never free() or realloc() memory that came from an arena. This also means that
+a list grown with ArenaAppend() must not be grown with Append(), and vice versa.
+*/
+typedef struct ArenaChunk ArenaChunk;
+struct ArenaChunk {
+    ArenaChunk *prev;
+    size_t used, size;
+    alignas(max_align_t) char data[];
+};
+typedef struct { ArenaChunk *chunk; } Arena;
+
+static inline void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+    ArenaChunk *c = arena->chunk;
+    if (!c || c->size - c->used < size) {
+        // Big allocations get a chunk of their own, behind the current chunk.
+        size_t chunksize = max(size, (size_t)64*1024 - sizeof *c);
+        ArenaChunk *newchunk = malloc(sizeof *newchunk + chunksize);
+        if (!newchunk) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        *newchunk = (ArenaChunk){ .used = 0, .size = chunksize };
+        if (c && chunksize > size) {
+            newchunk->prev = c;
+            arena->chunk = newchunk;
+        } else if (c) {
+            newchunk->prev = c->prev;
+            c->prev = newchunk;
+        } else {
+            arena->chunk = newchunk;
+        }
+        c = newchunk;
+    }
+
+    void *result = &c->data[c->used];
+    c->used += size;
+    memset(result, 0, size);
+    return result;
+}
+
+static inline void *arena_memdup(Arena *arena, const void *ptr, size_t size)
+{
+    void *result = arena_alloc(arena, size);
+    if (size)
+        memcpy(result, ptr, size);
+    return result;
+}
+
+static inline char *arena_strdup(Arena *arena, const char *s)
+{
+    return arena_memdup(arena, s, strlen(s) + 1);
+}
+
+static inline void arena_free(Arena *arena)
+{
+    while (arena->chunk) {
+        ArenaChunk *prev = arena->chunk->prev;
+        free(arena->chunk);
+        arena->chunk = prev;
+    }
+}
+
+// Like Append(), but the list's memory comes from an arena.
+#define ArenaAppend(arena, list, ...) do { \
+    if ((list)->alloc == (list)->len) { \
+        int arenaappend_alloc = (list)->alloc ? 2*(list)->alloc : 4; \
+        void *arenaappend_ptr = arena_alloc((arena), sizeof((list)->ptr[0]) * arenaappend_alloc); \
+        if ((list)->len) \
+            memcpy(arenaappend_ptr, (list)->ptr, sizeof((list)->ptr[0]) * (list)->len); \
+        (list)->ptr = arenaappend_ptr; \
+        (list)->alloc = arenaappend_alloc; \
+    } \
+    (list)->ptr[(list)->len++]=(__VA_ARGS__); \
+} while(0)
+
 // strcpy between two char arrays is safe, if there is enough room.
 // Not intended to replace all uses of strcpy(), only array-to-array copying.
 #define safe_strcpy(dest, src) do{ \